@@ -0,0 +1,861 @@
+#include "FrozenSketchIndex.h"
+
+#include <thread>
+#include <iostream>
+#include <fstream>
+#include <queue>
+#include <functional>
+#include <cstdint>
+
+
+struct HashSketchPair {
+    hash_t hash_value;
+    int sketch_index;
+
+    bool operator<(const HashSketchPair& other) const {
+        return hash_value < other.hash_value
+                || (hash_value == other.hash_value && sketch_index < other.sketch_index);
+    }
+};
+
+
+
+KeyLayout key_layout_from_name(const std::string& name) {
+    for (size_t i = 0; i < sizeof(KEY_LAYOUT_NAMES) / sizeof(KEY_LAYOUT_NAMES[0]); i++) {
+        if (name == KEY_LAYOUT_NAMES[i]) {
+            return (KeyLayout)i;
+        }
+    }
+    return KEYS_SORTED;
+}
+
+
+
+FrozenSketchIndex::FrozenSketchIndex(PostingCodec codec, KeyLayout key_layout) {
+    this->codec = codec;
+    this->key_layout = key_layout;
+    this->num_total_postings = 0;
+    this->num_indexed_sketches = 0;
+    this->fingerprint = 0;
+    this->entry_bits = 32;
+}
+
+
+
+// the fingerprint of n sketches is the sum of fingerprint(sketch i) * FINGERPRINT_BASE^(n - 1 - i)
+static const uint64_t FINGERPRINT_BASE = 0x9E3779B97F4A7C15ULL;
+
+// a 64-bit mixer (the finalizer of splitmix64)
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// the hash values of a sketch are sorted, so a sum of their mixes identifies them
+static uint64_t sketch_fingerprint(const Sketch& sketch) {
+    uint64_t sum = 0;
+    for (hash_t hash_value : sketch) {
+        sum += mix64(hash_value);
+    }
+    return mix64(sum + sketch.size());
+}
+
+// the fingerprint of the sketches of first, followed by the second_count sketches of second
+static uint64_t append_fingerprint(uint64_t first, uint64_t second, size_t second_count) {
+    uint64_t shift = 1;
+    uint64_t power = FINGERPRINT_BASE;
+    for (size_t n = second_count; n > 0; n >>= 1) {
+        if (n & 1) {
+            shift *= power;
+        }
+        power *= power;
+    }
+    return first * shift + second;
+}
+
+
+
+uint64_t FrozenSketchIndex::fingerprint_of(const std::vector<Sketch>& sketches, int num_threads) {
+    num_threads = std::max(num_threads, 1);
+    std::vector<uint64_t> sketch_fingerprints(sketches.size());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (size_t i = t; i < sketches.size(); i += num_threads) {
+                sketch_fingerprints[i] = sketch_fingerprint(sketches[i]);
+            }
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    uint64_t fingerprint = 0;
+    for (uint64_t of_sketch : sketch_fingerprints) {
+        fingerprint = fingerprint * FINGERPRINT_BASE + of_sketch;
+    }
+    return fingerprint;
+}
+
+
+
+// a list is hot when the sketch indices of one of its containers are too many for an array
+static bool is_hot_posting_list(const std::vector<int>& sketch_indices) {
+    if (sketch_indices.size() <= ROARING_ARRAY_LIMIT) {
+        return false;
+    }
+    for (size_t first = 0; first < sketch_indices.size(); ) {
+        int key = sketch_indices[first] >> 16;
+        size_t last = first;
+        while (last < sketch_indices.size() && (sketch_indices[last] >> 16) == key) last++;
+        if (last - first > ROARING_ARRAY_LIMIT) {
+            return true;
+        }
+        first = last;
+    }
+    return false;
+}
+
+
+
+// append the Roaring containers of increasing sketch indices to the posting bytes
+static void append_roaring_list(const std::vector<int>& sketch_indices, std::vector<uint8_t>& posting_bytes) {
+    for (size_t first = 0; first < sketch_indices.size(); ) {
+        uint16_t key = sketch_indices[first] >> 16;
+        size_t last = first;
+        while (last < sketch_indices.size() && (sketch_indices[last] >> 16) == key) last++;
+        uint32_t container_count = last - first;
+        const uint8_t* header_bytes = (const uint8_t*)&key;
+        posting_bytes.insert(posting_bytes.end(), header_bytes, header_bytes + 2);
+        header_bytes = (const uint8_t*)&container_count;
+        posting_bytes.insert(posting_bytes.end(), header_bytes, header_bytes + 4);
+        if (container_count > ROARING_ARRAY_LIMIT) {
+            std::vector<uint64_t> bitmap(ROARING_BITMAP_WORDS, 0);
+            for (size_t i = first; i < last; i++) {
+                uint16_t low = sketch_indices[i] & 0xffff;
+                bitmap[low / 64] |= (uint64_t)1 << (low % 64);
+            }
+            const uint8_t* bitmap_bytes = (const uint8_t*)bitmap.data();
+            posting_bytes.insert(posting_bytes.end(), bitmap_bytes, bitmap_bytes + 8 * ROARING_BITMAP_WORDS);
+        } else {
+            for (size_t i = first; i < last; i++) {
+                uint16_t low = sketch_indices[i] & 0xffff;
+                const uint8_t* low_bytes = (const uint8_t*)&low;
+                posting_bytes.insert(posting_bytes.end(), low_bytes, low_bytes + 2);
+            }
+        }
+        first = last;
+    }
+}
+
+
+
+// append one posting list (codec, varint count, sketch indices) to the posting bytes
+static void append_posting_list(const std::vector<int>& sketch_indices, PostingCodec codec, std::vector<uint8_t>& posting_bytes) {
+    if (is_hot_posting_list(sketch_indices)) {
+        codec = POSTINGS_ROARING;
+    } else if (codec == POSTINGS_RAW && sketch_indices.back() <= UINT16_MAX) {
+        codec = POSTINGS_RAW16;
+    }
+    posting_bytes.push_back(codec);
+    size_t count = sketch_indices.size();
+    while (count >= 0x80) {
+        posting_bytes.push_back((count & 0x7f) | 0x80);
+        count >>= 7;
+    }
+    posting_bytes.push_back(count);
+    if (codec == POSTINGS_ROARING) {
+        append_roaring_list(sketch_indices, posting_bytes);
+    } else if (codec == POSTINGS_STREAMVBYTE) {
+        streamvbyte_encode_deltas(sketch_indices.data(), sketch_indices.size(), posting_bytes);
+    } else if (codec == POSTINGS_RAW16) {
+        for (int sketch_index : sketch_indices) {
+            uint16_t narrow_index = sketch_index;
+            const uint8_t* bytes = (const uint8_t*)&narrow_index;
+            posting_bytes.insert(posting_bytes.end(), bytes, bytes + 2);
+        }
+    } else {
+        const uint8_t* bytes = (const uint8_t*)sketch_indices.data();
+        posting_bytes.insert(posting_bytes.end(), bytes, bytes + sketch_indices.size() * sizeof(int));
+    }
+}
+
+
+
+// sort the pairs: each thread sorts a chunk, then neighbouring chunks are merged in rounds
+static void parallel_sort_pairs(std::vector<HashSketchPair>& pairs, int num_threads) {
+    size_t num_pairs = pairs.size();
+    size_t chunk_size = (num_pairs + num_threads - 1) / num_threads;
+    if (num_threads <= 1 || chunk_size == 0) {
+        std::sort(pairs.begin(), pairs.end());
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t start = 0; start < num_pairs; start += chunk_size) {
+        size_t end = std::min(start + chunk_size, num_pairs);
+        threads.push_back(std::thread([&pairs, start, end]() {
+            std::sort(pairs.begin() + start, pairs.begin() + end);
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (size_t width = chunk_size; width < num_pairs; width *= 2) {
+        threads.clear();
+        for (size_t start = 0; start + width < num_pairs; start += 2 * width) {
+            size_t middle = start + width;
+            size_t end = std::min(start + 2 * width, num_pairs);
+            threads.push_back(std::thread([&pairs, start, middle, end]() {
+                std::inplace_merge(pairs.begin() + start, pairs.begin() + middle, pairs.begin() + end);
+            }));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+}
+
+
+
+// the (hash value, sketch index) pairs of all sketches, sorted; sketch i has the index first_sketch_index + i
+static void collect_sorted_pairs(const std::vector<Sketch>& sketches, int first_sketch_index, int num_threads,
+                                    std::vector<HashSketchPair>& pairs) {
+    // where the pairs of each sketch start
+    std::vector<size_t> first_pair_of_sketch(sketches.size() + 1, 0);
+    for (size_t i = 0; i < sketches.size(); i++) {
+        first_pair_of_sketch[i + 1] = first_pair_of_sketch[i] + sketches[i].size();
+    }
+    pairs.resize(first_pair_of_sketch.back());
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (size_t i = t; i < sketches.size(); i += num_threads) {
+                HashSketchPair* out = pairs.data() + first_pair_of_sketch[i];
+                for (hash_t hash_value : sketches[i]) {
+                    out->hash_value = hash_value;
+                    out->sketch_index = first_sketch_index + i;
+                    out++;
+                }
+            }
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    parallel_sort_pairs(pairs, num_threads);
+}
+
+
+
+void FrozenSketchIndex::build(const std::vector<Sketch>& sketches, int num_threads) {
+    num_threads = std::max(num_threads, 1);
+    std::vector<HashSketchPair> pairs;
+    collect_sorted_pairs(sketches, 0, num_threads, pairs);
+    size_t num_pairs = pairs.size();
+
+    // runs of equal hash values become the posting lists, runs of length one are kept inline
+    size_t num_distinct = 0;
+    size_t num_lists = 0;
+    size_t num_list_postings = 0;
+    for (size_t i = 0; i < num_pairs; ) {
+        size_t run_end = i + 1;
+        while (run_end < num_pairs && pairs[run_end].hash_value == pairs[i].hash_value) run_end++;
+        num_distinct++;
+        if (run_end - i > 1) {
+            num_lists++;
+            num_list_postings += run_end - i;
+        }
+        i = run_end;
+    }
+
+    std::vector<hash_t> hashes;
+    hashes.reserve(num_distinct);
+    std::vector<int32_t> hash_entries;
+    hash_entries.reserve(num_distinct);
+    std::vector<uint64_t> offsets;
+    offsets.reserve(num_lists);
+    std::vector<uint8_t> bytes;
+    // room for the raw lists with their headers, compressed lists are (almost always) smaller
+    bytes.reserve(num_list_postings * sizeof(int) + num_lists * 11 + STREAMVBYTE_PADDING);
+    std::vector<int> sketch_indices;
+    for (size_t i = 0; i < num_pairs; ) {
+        size_t run_end = i + 1;
+        while (run_end < num_pairs && pairs[run_end].hash_value == pairs[i].hash_value) run_end++;
+        hashes.push_back(pairs[i].hash_value);
+        if (run_end - i == 1) {
+            hash_entries.push_back(pairs[i].sketch_index);
+        } else {
+            hash_entries.push_back(-(int32_t)offsets.size() - 1);
+            offsets.push_back(bytes.size());
+            sketch_indices.clear();
+            for (size_t j = i; j < run_end; j++) {
+                sketch_indices.push_back(pairs[j].sketch_index);
+            }
+            append_posting_list(sketch_indices, codec, bytes);
+        }
+        i = run_end;
+    }
+
+    std::vector<HashSketchPair>().swap(pairs);
+    set_contents(hashes, hash_entries, offsets, bytes, num_pairs, sketches.size(), 
+                    fingerprint_of(sketches, num_threads));
+}
+
+
+
+bool FrozenSketchIndex::build_appended(const FrozenSketchIndex& base, const std::vector<Sketch>& new_sketches, 
+                                        int num_threads) {
+    // the lists of the base index are visited in the order of its keys
+    std::vector<hash_t> base_keys;
+    if (!base.get_sorted_keys(base_keys)) {
+        std::cerr << "Cannot append to an index with " << KEY_LAYOUT_NAMES[base.key_layout] 
+                    << " keys, its keys are not stored" << std::endl;
+        return false;
+    }
+
+    num_threads = std::max(num_threads, 1);
+    std::vector<HashSketchPair> pairs;
+    collect_sorted_pairs(new_sketches, base.num_indexed_sketches, num_threads, pairs);
+    size_t num_pairs = pairs.size();
+
+    std::vector<hash_t> hashes;
+    hashes.reserve(base_keys.size() + num_pairs);
+    std::vector<int32_t> hash_entries;
+    hash_entries.reserve(base_keys.size() + num_pairs);
+    std::vector<uint64_t> offsets;
+    offsets.reserve(base.list_offsets.size());
+    std::vector<uint8_t> bytes;
+    bytes.reserve(base.posting_bytes.size());
+    std::vector<int> sketch_indices;
+    size_t base_end = base.posting_bytes.size() - STREAMVBYTE_PADDING;
+    size_t rank = 0;
+    size_t i = 0;
+    while (rank < base_keys.size() || i < num_pairs) {
+        size_t run_end = i;
+        hash_t hash_value;
+        if (i < num_pairs && (rank == base_keys.size() || pairs[i].hash_value <= base_keys[rank])) {
+            hash_value = pairs[i].hash_value;
+            while (run_end < num_pairs && pairs[run_end].hash_value == hash_value) run_end++;
+        } else {
+            hash_value = base_keys[rank];
+        }
+        bool in_base = rank < base_keys.size() && base_keys[rank] == hash_value;
+        hashes.push_back(hash_value);
+
+        if (run_end == i) {
+            // not in the new sketches: the entry, or the encoded list, is copied as it is
+            int32_t entry = base.entry_of(rank);
+            if (entry >= 0) {
+                hash_entries.push_back(entry);
+            } else {
+                size_t list = -entry - 1;
+                size_t list_start = base.list_offsets[list];
+                size_t list_end = list + 1 < base.list_offsets.size() ? base.list_offsets[list + 1] : base_end;
+                hash_entries.push_back(-(int32_t)offsets.size() - 1);
+                offsets.push_back(bytes.size());
+                bytes.insert(bytes.end(), base.posting_bytes.begin() + list_start, base.posting_bytes.begin() + list_end);
+            }
+        } else {
+            // the new sketch indices are larger than all the old ones, so they go at the end of the list
+            sketch_indices.clear();
+            if (in_base) {
+                base.view_of(rank, base.list_of(rank)).decode(sketch_indices);
+            }
+            for (size_t j = i; j < run_end; j++) {
+                sketch_indices.push_back(pairs[j].sketch_index);
+            }
+            if (sketch_indices.size() == 1) {
+                hash_entries.push_back(sketch_indices[0]);
+            } else {
+                hash_entries.push_back(-(int32_t)offsets.size() - 1);
+                offsets.push_back(bytes.size());
+                append_posting_list(sketch_indices, codec, bytes);
+            }
+        }
+
+        if (in_base) {
+            rank++;
+        }
+        i = run_end;
+    }
+
+    std::vector<HashSketchPair>().swap(pairs);
+    std::vector<hash_t>().swap(base_keys);
+    set_contents(hashes, hash_entries, offsets, bytes, base.num_total_postings + num_pairs, 
+                    base.num_indexed_sketches + new_sketches.size(),
+                    append_fingerprint(base.fingerprint, fingerprint_of(new_sketches, num_threads), 
+                                        new_sketches.size()));
+    return true;
+}
+
+
+
+bool FrozenSketchIndex::get_sorted_keys(std::vector<hash_t>& keys) const {
+    if (!stores_keys()) {
+        return false;
+    }
+    KeyCursor cursor;
+    size_t first = keys.size();
+    keys.resize(first + size());
+    get_sorted_keys(cursor, keys.data() + first, size());
+    return true;
+}
+
+
+
+size_t FrozenSketchIndex::get_sorted_keys(KeyCursor& cursor, hash_t* keys, size_t max_count) const {
+    switch (key_layout) {
+        case KEYS_ELIAS_FANO:
+            return elias_fano_keys.get_keys(cursor, keys, max_count);
+        case KEYS_MPHF:
+            return 0;
+        case KEYS_DIRECTORY:
+            return directory_keys.get_keys(cursor, keys, max_count);
+        case KEYS_DIRECTORY_32:
+            return narrow_directory_keys.get_keys(cursor, keys, max_count);
+        case KEYS_SORTED_32:
+            return narrow_sorted_keys.get_keys(cursor, keys, max_count);
+        default:
+            return sorted_keys.get_keys(cursor, keys, max_count);
+    }
+}
+
+
+
+void FrozenSketchIndex::set_contents(std::vector<hash_t>& hashes, std::vector<int32_t>& hash_entries,
+                                        std::vector<uint64_t>& offsets, std::vector<uint8_t>& bytes,
+                                        size_t num_postings, size_t num_sketches, uint64_t sketches_fingerprint) {
+    // the decoders may read a little past the last list
+    bytes.resize(bytes.size() + STREAMVBYTE_PADDING, 0);
+    posting_bytes.assign(bytes);
+    num_total_postings = num_postings;
+    num_indexed_sketches = num_sketches;
+    fingerprint = sketches_fingerprint;
+    mapping.reset();
+
+    // the hash values are in increasing order, so the entries are by rank
+    if (key_layout == KEYS_ELIAS_FANO) {
+        elias_fano_keys.build(hashes);
+    } else if (key_layout == KEYS_DIRECTORY || key_layout == KEYS_DIRECTORY_32) {
+        // the narrow keys whenever they can hold the keys, whichever of the two was asked for
+        if (NarrowDirectoryKeySet::fits(hashes)) {
+            key_layout = KEYS_DIRECTORY_32;
+            narrow_directory_keys.build(hashes);
+        } else {
+            key_layout = KEYS_DIRECTORY;
+            directory_keys.build(hashes);
+        }
+    } else if (key_layout == KEYS_MPHF) {
+        mphf_keys.build(hashes);
+        std::vector<int32_t> entries_by_slot(hash_entries.size());
+        for (size_t i = 0; i < hashes.size(); i++) {
+            entries_by_slot[mphf_keys.find(hashes[i])] = hash_entries[i];
+        }
+        hash_entries.swap(entries_by_slot);
+        // the narrow entries number the lists by slot, so the lists are renumbered in that order
+        std::vector<uint64_t> offsets_by_slot;
+        offsets_by_slot.reserve(offsets.size());
+        for (int32_t& entry : hash_entries) {
+            if (entry < 0) {
+                offsets_by_slot.push_back(offsets[-entry - 1]);
+                entry = -(int32_t)offsets_by_slot.size();
+            }
+        }
+        offsets.swap(offsets_by_slot);
+    } else if (NarrowSortedKeySet::fits(hashes)) {
+        key_layout = KEYS_SORTED_32;
+        narrow_sorted_keys.build(hashes);
+    } else {
+        key_layout = KEYS_SORTED;
+        sorted_keys.build(hashes);
+    }
+    list_offsets.assign(offsets);
+
+    entries.clear();
+    narrow_entries.clear();
+    list_blocks.clear();
+    if (num_sketches > 65536) {
+        entry_bits = 32;
+        entries.assign(hash_entries);
+        return;
+    }
+    entry_bits = 16;
+    std::vector<uint16_t> sketch_index_entries(hash_entries.size(), 0);
+    std::vector<uint64_t> blocks(2 * ((hash_entries.size() + 63) / 64), 0);
+    uint64_t num_lists_before = 0;
+    for (size_t slot = 0; slot < hash_entries.size(); slot++) {
+        if (slot % 64 == 0) {
+            blocks[2 * (slot / 64)] = num_lists_before;
+        }
+        if (hash_entries[slot] >= 0) {
+            sketch_index_entries[slot] = (uint16_t)hash_entries[slot];
+        } else {
+            blocks[2 * (slot / 64) + 1] |= (uint64_t)1 << (slot % 64);
+            num_lists_before++;
+        }
+    }
+    std::vector<int32_t>().swap(hash_entries);
+    narrow_entries.assign(sketch_index_entries);
+    list_blocks.assign(blocks);
+}
+
+
+
+bool FrozenSketchIndex::save(const std::string& index_path) const {
+    std::ofstream file(index_path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open the file: " << index_path << std::endl;
+        return false;
+    }
+
+    FrozenIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FROZEN_INDEX_MAGIC, sizeof(FROZEN_INDEX_MAGIC));
+    header.version = FROZEN_INDEX_VERSION;
+    header.codec = codec;
+    header.key_layout = key_layout;
+    header.entry_bits = entry_bits;
+    header.num_sketches = num_indexed_sketches;
+    header.num_postings = num_total_postings;
+    header.sketches_fingerprint = fingerprint;
+    file.write((const char*)&header, sizeof(header));
+
+    IndexFileWriter writer(file);
+    switch (key_layout) {
+        case KEYS_ELIAS_FANO:
+            elias_fano_keys.save(writer);
+            break;
+        case KEYS_MPHF:
+            mphf_keys.save(writer);
+            break;
+        case KEYS_DIRECTORY:
+            directory_keys.save(writer);
+            break;
+        case KEYS_DIRECTORY_32:
+            narrow_directory_keys.save(writer);
+            break;
+        case KEYS_SORTED_32:
+            narrow_sorted_keys.save(writer);
+            break;
+        default:
+            sorted_keys.save(writer);
+    }
+    if (entry_bits == 32) {
+        writer.write_array(entries);
+    } else {
+        writer.write_array(narrow_entries);
+        writer.write_array(list_blocks);
+    }
+    writer.write_array(list_offsets);
+    writer.write_array(posting_bytes);
+
+    file.close();
+    if (!file) {
+        std::cerr << "Could not write the index: " << index_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+
+bool FrozenSketchIndex::load(const std::string& index_path) {
+    // lookups go all over the index, no sequential readahead
+    std::shared_ptr<MappedFile> mapped_file = std::make_shared<MappedFile>();
+    mapped_file->open(index_path, false);
+    const char* data = mapped_file->data();
+    size_t size = mapped_file->size();
+    if (!mapped_file->is_open() || size < sizeof(FrozenIndexHeader) 
+            || memcmp(data, FROZEN_INDEX_MAGIC, sizeof(FROZEN_INDEX_MAGIC)) != 0) {
+        return false;
+    }
+    FrozenIndexHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.version != FROZEN_INDEX_VERSION || header.codec > POSTINGS_STREAMVBYTE 
+            || header.key_layout > KEYS_SORTED_32 || (header.entry_bits != 32 && header.entry_bits != 16)) {
+        std::cerr << "Unsupported index version or format: " << index_path << std::endl;
+        return false;
+    }
+
+    // fill a new index, so that this one is left as it was if the file is invalid
+    FrozenSketchIndex loaded((PostingCodec)header.codec, (KeyLayout)header.key_layout);
+    IndexFileReader reader(data + sizeof(header), size - sizeof(header));
+    bool keys_loaded;
+    size_t num_keys;
+    switch (loaded.key_layout) {
+        case KEYS_ELIAS_FANO:
+            keys_loaded = loaded.elias_fano_keys.load(reader);
+            num_keys = loaded.elias_fano_keys.size();
+            break;
+        case KEYS_MPHF:
+            keys_loaded = loaded.mphf_keys.load(reader);
+            num_keys = loaded.mphf_keys.size();
+            break;
+        case KEYS_DIRECTORY:
+            keys_loaded = loaded.directory_keys.load(reader);
+            num_keys = loaded.directory_keys.size();
+            break;
+        case KEYS_DIRECTORY_32:
+            keys_loaded = loaded.narrow_directory_keys.load(reader);
+            num_keys = loaded.narrow_directory_keys.size();
+            break;
+        case KEYS_SORTED_32:
+            keys_loaded = loaded.narrow_sorted_keys.load(reader);
+            num_keys = loaded.narrow_sorted_keys.size();
+            break;
+        default:
+            keys_loaded = loaded.sorted_keys.load(reader);
+            num_keys = loaded.sorted_keys.size();
+    }
+    loaded.entry_bits = header.entry_bits;
+    bool entries_loaded;
+    if (loaded.entry_bits == 32) {
+        entries_loaded = reader.read_array(loaded.entries);
+    } else {
+        entries_loaded = reader.read_array(loaded.narrow_entries) && reader.read_array(loaded.list_blocks)
+                            && loaded.list_blocks.size() == 2 * ((loaded.narrow_entries.size() + 63) / 64);
+    }
+    bool lists_loaded = reader.read_array(loaded.list_offsets) && reader.read_array(loaded.posting_bytes)
+                            && loaded.posting_bytes.size() >= STREAMVBYTE_PADDING;
+    // the arrays must agree with each other: one entry per key, every list starts within the 
+    // posting bytes, and the narrow entries number exactly the lists there are
+    if (lists_loaded) {
+        size_t lists_end = loaded.posting_bytes.size() - STREAMVBYTE_PADDING;
+        for (size_t list = 0; list < loaded.list_offsets.size() && lists_loaded; list++) {
+            lists_loaded = loaded.list_offsets[list] < lists_end;
+        }
+    }
+    if (lists_loaded && entries_loaded && loaded.entry_bits == 16 && loaded.list_blocks.size() > 0) {
+        const uint64_t* last_block = loaded.list_blocks.data() + loaded.list_blocks.size() - 2;
+        lists_loaded = last_block[0] + __builtin_popcountll(last_block[1]) == loaded.list_offsets.size();
+    }
+    if (!keys_loaded || !entries_loaded || !lists_loaded || loaded.size() != num_keys) {
+        std::cerr << "Invalid index: " << index_path << std::endl;
+        return false;
+    }
+    loaded.num_indexed_sketches = header.num_sketches;
+    loaded.num_total_postings = header.num_postings;
+    loaded.fingerprint = header.sketches_fingerprint;
+    loaded.mapping = mapped_file;
+    *this = loaded;
+    return true;
+}
+
+
+
+// one input of merge_saved: its keys are read a block at a time
+struct MergeInput {
+    static const size_t BLOCK_SIZE = 4096;
+
+    const FrozenSketchIndex* index;
+    int first_sketch_index;     // what its sketch indices are shifted by
+    KeyCursor cursor;
+    std::vector<hash_t> block;
+    size_t block_position;
+    size_t rank;                // the rank (slot) of the current key
+
+    void start(const FrozenSketchIndex* index, int first_sketch_index) {
+        this->index = index;
+        this->first_sketch_index = first_sketch_index;
+        this->cursor = KeyCursor();
+        this->rank = 0;
+        refill();
+    }
+
+    bool done() const {
+        return block_position == block.size();
+    }
+
+    hash_t key() const {
+        return block[block_position];
+    }
+
+    void next() {
+        block_position++;
+        rank++;
+        if (block_position == block.size()) {
+            refill();
+        }
+    }
+
+    void refill() {
+        block.resize(BLOCK_SIZE);
+        block.resize(index->get_sorted_keys(cursor, block.data(), BLOCK_SIZE));
+        block_position = 0;
+    }
+};
+
+
+
+// k-way merge of the keys of the inputs: function(hash value, inputs holding it, in input order) 
+// is called for every distinct hash value, in increasing order
+template <class Function>
+static void merge_keys(const std::vector<FrozenSketchIndex>& indexes, const std::vector<int>& first_sketch_indices,
+                        Function function) {
+    typedef std::pair<hash_t, size_t> HeapItem;
+    std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem>> heap;
+    std::vector<MergeInput> inputs(indexes.size());
+    for (size_t k = 0; k < indexes.size(); k++) {
+        inputs[k].start(&indexes[k], first_sketch_indices[k]);
+        if (!inputs[k].done()) {
+            heap.push(HeapItem(inputs[k].key(), k));
+        }
+    }
+
+    std::vector<const MergeInput*> holders;
+    while (!heap.empty()) {
+        hash_t hash_value = heap.top().first;
+        holders.clear();
+        while (!heap.empty() && heap.top().first == hash_value) {
+            holders.push_back(&inputs[heap.top().second]);
+            heap.pop();
+        }
+        function(hash_value, holders);
+        for (const MergeInput* holder : holders) {
+            MergeInput& input = inputs[holder - inputs.data()];
+            input.next();
+            if (!input.done()) {
+                heap.push(HeapItem(input.key(), holder - inputs.data()));
+            }
+        }
+    }
+}
+
+
+
+bool FrozenSketchIndex::merge_saved(const std::vector<std::string>& index_paths, const std::string& output_path, 
+                                    PostingCodec codec) {
+    std::vector<FrozenSketchIndex> indexes(index_paths.size());
+    std::vector<int> first_sketch_indices;
+    size_t num_sketches = 0;
+    size_t num_postings = 0;
+    uint64_t fingerprint = 0;
+    for (size_t k = 0; k < index_paths.size(); k++) {
+        if (!indexes[k].load(index_paths[k])) {
+            std::cerr << "Not a saved index: " << index_paths[k] << std::endl;
+            return false;
+        }
+        if (!indexes[k].stores_keys()) {
+            std::cerr << "Cannot merge an index with " << KEY_LAYOUT_NAMES[indexes[k].key_layout] 
+                        << " keys, its keys are not stored: " << index_paths[k] << std::endl;
+            return false;
+        }
+        first_sketch_indices.push_back(num_sketches);
+        num_sketches += indexes[k].num_indexed_sketches;
+        num_postings += indexes[k].num_total_postings;
+        fingerprint = append_fingerprint(fingerprint, indexes[k].fingerprint, indexes[k].num_indexed_sketches);
+    }
+
+    // first pass: count the distinct keys and the posting lists, to know where the sections go
+    size_t num_keys = 0;
+    size_t num_lists = 0;
+    hash_t max_key = 0;
+    merge_keys(indexes, first_sketch_indices, [&](hash_t hash_value, const std::vector<const MergeInput*>& holders) {
+        size_t count = 0;
+        for (const MergeInput* holder : holders) {
+            count += holder->index->view_of(holder->rank, holder->index->list_of(holder->rank)).size();
+        }
+        num_keys++;
+        num_lists += count > 1;
+        max_key = hash_value;
+    });
+
+    // the layout written by save, with KEYS_SORTED: each section is written by its own stream
+    size_t keys_offset = sizeof(FrozenIndexHeader);
+    size_t entries_offset = keys_offset + 8 + num_keys * sizeof(hash_t) + 8;
+    size_t list_offsets_offset = entries_offset + 8 + (num_keys * sizeof(int32_t) + 7) / 8 * 8;
+    size_t posting_bytes_offset = list_offsets_offset + 8 + num_lists * sizeof(uint64_t);
+
+    std::ofstream file(output_path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open the file: " << output_path << std::endl;
+        return false;
+    }
+    FrozenIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FROZEN_INDEX_MAGIC, sizeof(FROZEN_INDEX_MAGIC));
+    header.version = FROZEN_INDEX_VERSION;
+    header.codec = codec;
+    header.key_layout = KEYS_SORTED;
+    header.entry_bits = 32;
+    header.num_sketches = num_sketches;
+    header.num_postings = num_postings;
+    header.sketches_fingerprint = fingerprint;
+    file.write((const char*)&header, sizeof(header));
+    file.flush();
+
+    std::fstream keys_file(output_path, std::ios::in | std::ios::out | std::ios::binary);
+    std::fstream entries_file(output_path, std::ios::in | std::ios::out | std::ios::binary);
+    std::fstream list_offsets_file(output_path, std::ios::in | std::ios::out | std::ios::binary);
+    keys_file.seekp(keys_offset);
+    entries_file.seekp(entries_offset);
+    list_offsets_file.seekp(list_offsets_offset);
+    file.seekp(posting_bytes_offset);
+    IndexFileWriter keys_writer(keys_file);
+    IndexFileWriter entries_writer(entries_file);
+    IndexFileWriter list_offsets_writer(list_offsets_file);
+    IndexFileWriter posting_bytes_writer(file);
+    keys_writer.begin_array(num_keys);
+    entries_writer.begin_array(num_keys);
+    list_offsets_writer.begin_array(num_lists);
+    posting_bytes_writer.begin_array(0);        // the size is known at the end
+
+    // second pass: merge the posting lists, with the sketch indices of each input shifted
+    std::vector<int> sketch_indices;
+    std::vector<uint8_t> list_bytes;
+    uint64_t num_bytes = 0;
+    int32_t num_written_lists = 0;
+    merge_keys(indexes, first_sketch_indices, [&](hash_t hash_value, const std::vector<const MergeInput*>& holders) {
+        sketch_indices.clear();
+        for (const MergeInput* holder : holders) {
+            int shift = holder->first_sketch_index;
+            holder->index->view_of(holder->rank, holder->index->list_of(holder->rank)).for_each([&](int sketch_index) {
+                sketch_indices.push_back(sketch_index + shift);
+            });
+        }
+        int32_t entry;
+        if (sketch_indices.size() == 1) {
+            entry = sketch_indices[0];
+        } else {
+            entry = -num_written_lists - 1;
+            num_written_lists++;
+            list_offsets_writer.write_elements(&num_bytes, 1);
+            list_bytes.clear();
+            append_posting_list(sketch_indices, codec, list_bytes);
+            posting_bytes_writer.write_elements(list_bytes.data(), list_bytes.size());
+            num_bytes += list_bytes.size();
+        }
+        keys_writer.write_elements(&hash_value, 1);
+        entries_writer.write_elements(&entry, 1);
+    });
+
+    // the decoders may read a little past the last list
+    std::vector<uint8_t> padding(STREAMVBYTE_PADDING, 0);
+    posting_bytes_writer.write_elements(padding.data(), padding.size());
+    num_bytes += padding.size();
+    posting_bytes_writer.end_array();
+    file.seekp(posting_bytes_offset);
+    posting_bytes_writer.write_value(num_bytes);
+    keys_writer.end_array();
+    keys_writer.write_value(num_keys == 0 ? 0.0 : num_keys / ((double)max_key + 1));
+    entries_writer.end_array();
+    list_offsets_writer.end_array();
+
+    keys_file.close();
+    entries_file.close();
+    list_offsets_file.close();
+    file.close();
+    if (!file || !keys_file || !entries_file || !list_offsets_file) {
+        std::cerr << "Could not write the index: " << output_path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,607 @@
+#ifndef FROZENSKETCHINDEX_H
+#define FROZENSKETCHINDEX_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+
+#include "Sketch.h"
+#include "StreamVByte.h"
+#include "KeySets.h"
+#include "IndexFile.h"
+#include "MappedFile.h"
+
+
+#ifndef HASH_T
+#define HASH_T
+typedef unsigned long long int hash_t;
+#endif
+
+
+/**
+ * @brief How the posting lists of a FrozenSketchIndex are stored.
+ */
+enum PostingCodec {
+    POSTINGS_RAW = 0,           // 32-bit sketch indices
+    POSTINGS_STREAMVBYTE = 1,   // differences of consecutive sketch indices, StreamVByte encoded
+    POSTINGS_ROARING = 2,       // Roaring-style containers, for the lists of hot hash values only (see below)
+    POSTINGS_RAW16 = 3          // 16-bit sketch indices, for the POSTINGS_RAW lists of indices below 65536 only
+};
+
+
+
+/*
+Roaring posting lists: the sketch indices are grouped by their high 16 bits, 
+each group is a container:
+    key         uint16, the high 16 bits
+    count       uint32, the number of sketch indices in the container
+    values      a bitmap of 65536 bits (uint64[1024]) if count > ROARING_ARRAY_LIMIT,
+                otherwise the count low 16 bits (uint16[count]), in increasing order
+The lists of hot hash values (found in many sketches) are stored this way
+whatever the codec of the index: a list is a Roaring list when at least one
+of its containers is a bitmap. The others use the codec of the index.
+*/
+
+const size_t ROARING_ARRAY_LIMIT = 4096;
+const size_t ROARING_BITMAP_WORDS = 1024;
+
+
+
+/**
+ * @brief How the distinct hash values of a FrozenSketchIndex are stored (see KeySets.h).
+ */
+enum KeyLayout {
+    KEYS_SORTED = 0,            // sorted array of 64-bit keys
+    KEYS_ELIAS_FANO = 1,        // Elias-Fano encoded sorted keys
+    KEYS_MPHF = 2,              // minimal perfect hash function and 16-bit fingerprints, no keys
+    KEYS_DIRECTORY = 3,         // sorted array with a directory on the top bits of the keys
+    KEYS_DIRECTORY_32 = 4,      // KEYS_DIRECTORY with 32-bit key remainders, chosen by KEYS_DIRECTORY when they fit
+    KEYS_SORTED_32 = 5          // sorted 32-bit low halves by high half, chosen by KEYS_SORTED when the keys are dense enough
+};
+
+
+/**
+ * @brief The names of the key layouts, as given on the command line.
+ */
+const char* const KEY_LAYOUT_NAMES[] = {"sorted", "elias-fano", "mphf", "directory", "directory-32", "sorted-32"};
+
+
+/**
+ * @brief Get the key layout with the given name (KEYS_SORTED if unknown).
+ */
+KeyLayout key_layout_from_name(const std::string& name);
+
+
+
+/*
+Saved frozen index: the arrays of the index written with IndexFileWriter (see
+IndexFile.h) after a fixed header, so that the file can be memory mapped and
+queried in place:
+    header          FrozenIndexHeader
+    key set         the fields of the key set of the key layout
+    entries         array of int32, or (entry_bits 16) array of uint16 and array of uint64 list blocks
+    list offsets    array of uint64
+    posting bytes   array of uint8
+*/
+
+const char FROZEN_INDEX_MAGIC[8] = {'S', 'M', 'S', 'K', 'I', 'N', 'D', 'X'};
+const uint32_t FROZEN_INDEX_VERSION = 3;
+
+struct FrozenIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t codec;             // a PostingCodec
+    uint32_t key_layout;        // a KeyLayout
+    uint32_t entry_bits;        // 32, or 16 for the narrow entries of at most 65536 sketches
+    uint64_t num_sketches;      // the sketch indices are 0 to num_sketches - 1
+    uint64_t num_postings;
+    uint64_t sketches_fingerprint;  // see FrozenSketchIndex::fingerprint_of
+};
+
+
+
+/**
+ * @brief A read-only view on the posting list of a hash in a FrozenSketchIndex.
+ * 
+ * The list may be compressed, so the sketch indices are visited with for_each,
+ * which decodes them on the fly (a block at a time, with SIMD if available).
+ */
+class PostingView {
+    public:
+        PostingView() : codec(POSTINGS_RAW), count(0), data(nullptr) {}
+        PostingView(PostingCodec codec, size_t count, const uint8_t* data) : codec(codec), count(count), data(data) {}
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        /**
+         * @brief Call function(sketch_index) for every sketch index of the list, in increasing order.
+         */
+        template <class Function>
+        void for_each(Function function) const {
+            if (codec == POSTINGS_ROARING) {
+                for_each_roaring(function);
+                return;
+            }
+            if (codec == POSTINGS_RAW) {
+                for_each_raw<int32_t>(function);
+                return;
+            }
+            if (codec == POSTINGS_RAW16) {
+                for_each_raw<uint16_t>(function);
+                return;
+            }
+            const size_t block_size = 64;
+            int block[block_size];
+            const uint8_t* values = data + (count + 3) / 4;
+            int previous = 0;
+            for (size_t done = 0; done < count; done += block_size) {
+                size_t num_values = std::min(block_size, count - done);
+                streamvbyte_decode_deltas(data + done / 4, values, num_values, previous, block);
+                for (size_t i = 0; i < num_values; i++) {
+                    function(block[i]);
+                }
+                previous = block[num_values - 1];
+            }
+        }
+
+        /**
+         * @brief Append all sketch indices of the list to a vector.
+         */
+        void decode(std::vector<int>& sketch_indices) const {
+            for_each([&sketch_indices](int sketch_index) { sketch_indices.push_back(sketch_index); });
+        }
+
+    private:
+        PostingCodec codec;
+        size_t count;
+        const uint8_t* data;
+
+        // the uncompressed lists, of int32 or uint16 sketch indices
+        template <class SketchIndex, class Function>
+        void for_each_raw(Function function) const {
+            for (size_t i = 0; i < count; i++) {
+                SketchIndex sketch_index;
+                memcpy(&sketch_index, data + sizeof(SketchIndex) * i, sizeof(SketchIndex));
+                function((int)sketch_index);
+            }
+        }
+
+        // the bitmaps are visited a word at a time, one count trailing zeros per sketch index
+        template <class Function>
+        void for_each_roaring(Function function) const {
+            const uint8_t* container = data;
+            for (size_t done = 0; done < count; ) {
+                uint16_t key;
+                uint32_t container_count;
+                memcpy(&key, container, 2);
+                memcpy(&container_count, container + 2, 4);
+                container += 6;
+                int high = (int)key << 16;
+                if (container_count > ROARING_ARRAY_LIMIT) {
+                    for (size_t w = 0; w < ROARING_BITMAP_WORDS; w++) {
+                        uint64_t word;
+                        memcpy(&word, container + 8 * w, 8);
+                        while (word != 0) {
+                            function(high | (int)(w * 64 + __builtin_ctzll(word)));
+                            word &= word - 1;
+                        }
+                    }
+                    container += 8 * ROARING_BITMAP_WORDS;
+                } else {
+                    for (uint32_t i = 0; i < container_count; i++) {
+                        uint16_t low;
+                        memcpy(&low, container + 2 * i, 2);
+                        function(high | low);
+                    }
+                    container += 2 * container_count;
+                }
+                done += container_count;
+            }
+        }
+};
+
+
+
+/**
+ * @brief Immutable index of many sketches, in compressed sparse row layout.
+ * 
+ * The distinct hash values are kept in a key set (chosen by the KeyLayout),
+ * which gives the slot i of a hash value. Most hash values appear in a single
+ * sketch, so the hash in slot i has one entry: if entries[i] >= 0 it is
+ * the only sketch index of the hash, and the view returned by find points at
+ * the entry itself. Otherwise list = -entries[i] - 1, and the posting list (the
+ * sketch indices in which the hash appears, in increasing order) starts at 
+ * posting_bytes[list_offsets[list]] (the entries are narrowed below, for few sketches):
+ *     codec       uint8, a PostingCodec
+ *     count       varint, the number of sketch indices
+ *     indices     count int32 (POSTINGS_RAW), or count uint16 (POSTINGS_RAW16, when the
+ *                 largest is below 65536), a StreamVByte list (POSTINGS_STREAMVBYTE)
+ *                 or Roaring containers (POSTINGS_ROARING, for the lists of hot hash values)
+ * With at most 65536 sketches, the entries are 16 bits instead: the sketch index
+ * of the slots without a list, and a bit per slot for those with a list, whose
+ * list is then the number of such bits before it (counted in blocks of 64
+ * slots, each with the number of lists before it), about 18 bits per slot.
+ * The index is built once from all the sketches and never changes afterwards,
+ * so lookups are const, lock free and allocation free, and can be made from 
+ * any number of threads.
+ * 
+ * The index can be saved to a file, and loaded back by mapping the file: its
+ * arrays are then used in place, nothing is rebuilt.
+ * 
+ * Gather does not remove the hashes of a matched reference from the index:
+ * it drops them from its query instead, so they are never looked up again.
+ */
+class FrozenSketchIndex {
+    public:
+        /**
+         * @param codec How the posting lists of more than one sketch index are stored.
+         * @param key_layout How the distinct hash values are stored (KEYS_DIRECTORY becomes
+         *                   KEYS_DIRECTORY_32 when the key remainders fit in 32 bits, and
+         *                   KEYS_SORTED becomes KEYS_SORTED_32 when the keys are dense enough).
+         */
+        FrozenSketchIndex(PostingCodec codec = POSTINGS_RAW, KeyLayout key_layout = KEYS_SORTED);
+
+        /**
+         * @brief Build the index from sketches, replacing any previous contents.
+         * 
+         * All (hash value, sketch index) pairs are sorted in parallel, then the
+         * runs of equal hash values become the posting lists.
+         * 
+         * @param sketches The sketches, the sketch index of a hash is the position of its sketch.
+         * @param num_threads The number of threads to use.
+         */
+        void build(const std::vector<Sketch>& sketches, int num_threads);
+
+
+        /**
+         * @brief Build the index of the sketches of another index, followed by new sketches.
+         * 
+         * The new sketches get the sketch indices base.num_sketches() onwards.
+         * The keys of the base index are merged with the sorted pairs of the new
+         * sketches: posting lists of hash values which are not in the new sketches
+         * are copied as they are (still encoded), only the lists of hash values in
+         * the new sketches are decoded and extended. The base index is not changed.
+         * 
+         * @param base The index to extend, which must store its keys (not KEYS_MPHF).
+         * @param new_sketches The sketches to add.
+         * @param num_threads The number of threads to use.
+         * @return true If the index was built.
+         * @return false If the keys of the base index cannot be listed.
+         */
+        bool build_appended(const FrozenSketchIndex& base, const std::vector<Sketch>& new_sketches, int num_threads);
+
+
+        /**
+         * @brief Append the distinct hash values of the index to a vector, in increasing order.
+         * 
+         * @return false If the key layout does not store the keys (KEYS_MPHF).
+         */
+        bool get_sorted_keys(std::vector<hash_t>& keys) const;
+
+
+        /**
+         * @brief List the next distinct hash values of the index, in increasing order.
+         * 
+         * @param cursor Where the listing stands, a new KeyCursor starts from the smallest hash value.
+         * @param keys Where to write the hash values.
+         * @param max_count The most hash values to write.
+         * @return size_t The number of hash values written (0 at the end, or for KEYS_MPHF).
+         */
+        size_t get_sorted_keys(KeyCursor& cursor, hash_t* keys, size_t max_count) const;
+
+
+        /**
+         * @brief Check if the hash values can be listed (the key layout stores them).
+         */
+        bool stores_keys() const {
+            return key_layout != KEYS_MPHF;
+        }
+
+
+        /**
+         * @brief Merge saved indexes into one saved index, with a k-way merge of their keys.
+         * 
+         * The sketches of the merged index are those of the first index, then those
+         * of the second one, and so on: the sketch indices of each index are shifted
+         * by the number of sketches of the indexes before it. The inputs are mapped
+         * and streamed through twice (once to count the keys and lists, once to 
+         * write them), and the output sections are written as they are produced, 
+         * so memory does not grow with the size of the indexes. The merged index
+         * has KEYS_SORTED keys and 32-bit entries (the other layouts, and the narrow
+         * types, are chosen from all the keys).
+         * 
+         * @param index_paths The saved indexes to merge, which must store their keys (not KEYS_MPHF).
+         * @param output_path The path of the merged index to write (not one of the inputs).
+         * @param codec How the posting lists of the merged index are stored.
+         * @return true If the merged index was written.
+         * @return false If an input is not a valid saved index, or the output could not be written.
+         */
+        static bool merge_saved(const std::vector<std::string>& index_paths, const std::string& output_path, 
+                                PostingCodec codec);
+
+
+        /**
+         * @brief Save the index to a file (see FrozenIndexHeader for the layout).
+         * 
+         * @param index_path The path of the file to write.
+         * @return true If the index was written.
+         * @return false If the file could not be written.
+         */
+        bool save(const std::string& index_path) const;
+
+
+        /**
+         * @brief Load an index saved with save, replacing any previous contents.
+         * 
+         * The file is memory mapped and the arrays of the index point into the 
+         * mapping, which is kept for the lifetime of the index. The codec and
+         * key layout are those of the saved index.
+         * 
+         * @param index_path The path of the saved index.
+         * @return true If the index was loaded.
+         * @return false If the file is not a valid saved index.
+         */
+        bool load(const std::string& index_path);
+
+
+        /**
+         * @brief Find the posting list of a hash value.
+         * 
+         * @param hash_value The hash value to look up.
+         * @return PostingView The sketch indices in which the hash value appears (empty if none).
+         */
+        PostingView find(hash_t hash_value) const {
+            long slot = slot_of(hash_value);
+            if (slot < 0) {
+                return PostingView();
+            }
+            return view_of(slot, list_of(slot));
+        }
+
+
+        /**
+         * @brief Find the posting lists of many hash values, with software prefetching.
+         * 
+         * The lookups are pipelined: while the posting list of one hash value is
+         * delivered, the entries and lists of the next ones are being loaded, and
+         * the key set is being probed further ahead, so the cache misses of
+         * consecutive lookups overlap instead of waiting on each other. Sorted
+         * hash values walk the key set in one direction, which helps further.
+         * 
+         * @param sorted_hashes The hash values to look up (in increasing order for best speed).
+         * @param n The number of hash values.
+         * @param callback Called as callback(i, view) for i = 0 to n - 1, in order, 
+         *                 where view is find(sorted_hashes[i]) (empty if the hash is absent).
+         */
+        template <class Callback>
+        void lookup_batch(const hash_t* sorted_hashes, size_t n, Callback callback) const {
+            // stages, each LOOKUP_PREFETCH_DISTANCE lookups behind the previous one: prefetch
+            // the keys, find the slot and prefetch its entry, find and prefetch the list, deliver
+            const size_t distance = LOOKUP_PREFETCH_DISTANCE;
+            const size_t ring_mask = 4 * distance - 1;
+            long slots[4 * distance];
+            const uint8_t* lists[4 * distance];
+            for (size_t i = 0; i < n + 3 * distance; i++) {
+                if (i < n) {
+                    prefetch_keys(sorted_hashes[i]);
+                }
+                if (i >= distance && i - distance < n) {
+                    size_t j = i - distance;
+                    slots[j & ring_mask] = slot_of(sorted_hashes[j]);
+                    if (slots[j & ring_mask] >= 0) {
+                        prefetch_entry(slots[j & ring_mask]);
+                    }
+                }
+                if (i >= 2 * distance && i - 2 * distance < n) {
+                    size_t j = i - 2 * distance;
+                    const uint8_t* list = slots[j & ring_mask] >= 0 ? list_of(slots[j & ring_mask]) : nullptr;
+                    if (list != nullptr) {
+                        __builtin_prefetch(list);
+                    }
+                    lists[j & ring_mask] = list;
+                }
+                if (i >= 3 * distance) {
+                    size_t j = i - 3 * distance;
+                    long slot = slots[j & ring_mask];
+                    callback(j, slot < 0 ? PostingView() : view_of(slot, lists[j & ring_mask]));
+                }
+            }
+        }
+
+
+        /**
+         * @brief Check if a hash value exists in the index.
+         */
+        bool hash_exists(hash_t hash_value) const {
+            return slot_of(hash_value) >= 0;
+        }
+
+
+        /**
+         * @brief Get the number of distinct hash values in the index.
+         */
+        size_t size() const {
+            return entry_bits == 32 ? entries.size() : narrow_entries.size();
+        }
+
+
+        /**
+         * @brief Get the total length of all posting lists.
+         */
+        size_t num_postings() const {
+            return num_total_postings;
+        }
+
+        /**
+         * @brief Get how the posting lists of more than one sketch index are stored.
+         */
+        PostingCodec posting_codec() const {
+            return codec;
+        }
+
+        /**
+         * @brief Get how the distinct hash values are stored.
+         */
+        KeyLayout keys_layout() const {
+            return key_layout;
+        }
+
+        /**
+         * @brief Get the number of sketches the index was built from.
+         */
+        size_t num_sketches() const {
+            return num_indexed_sketches;
+        }
+
+        /**
+         * @brief Get the fingerprint of the sketches the index was built from (see fingerprint_of).
+         */
+        uint64_t sketches_fingerprint() const {
+            return fingerprint;
+        }
+
+        /**
+         * @brief Get a fingerprint of the hash values of sketches, which depends on their order.
+         * 
+         * A saved index keeps the fingerprint of its sketches, so that an index built
+         * from other sketches (or from the same ones in another order) is not used
+         * in their place. It is computed from the hash values rather than the md5s,
+         * which are not kept when the metadata of the sketches is loaded lazily.
+         * The fingerprint of sketches appended to others follows from the
+         * fingerprints of both, so that appended and merged indexes keep one too.
+         */
+        static uint64_t fingerprint_of(const std::vector<Sketch>& sketches, int num_threads);
+
+        /**
+         * @brief Get the number of bytes used by the index.
+         */
+        size_t memory_usage() const {
+            size_t keys_memory = sorted_keys.memory_usage() + elias_fano_keys.memory_usage() 
+                                    + mphf_keys.memory_usage() + directory_keys.memory_usage()
+                                    + narrow_directory_keys.memory_usage() + narrow_sorted_keys.memory_usage();
+            return keys_memory + entries.size() * sizeof(int32_t) + narrow_entries.size() * sizeof(uint16_t)
+                    + list_blocks.size() * sizeof(uint64_t) + list_offsets.size() * sizeof(uint64_t) + posting_bytes.size();
+        }
+
+    private:
+        // how many lookups apart the stages of lookup_batch are
+        static const size_t LOOKUP_PREFETCH_DISTANCE = 8;
+
+        PostingCodec codec;
+        KeyLayout key_layout;
+        SortedKeySet sorted_keys;
+        EliasFanoKeySet elias_fano_keys;
+        MphfKeySet mphf_keys;
+        DirectoryKeySet directory_keys;
+        NarrowDirectoryKeySet narrow_directory_keys;
+        NarrowSortedKeySet narrow_sorted_keys;
+        int entry_bits;
+        IndexArray<int32_t> entries;            // by slot, with 32-bit entries
+        IndexArray<uint16_t> narrow_entries;    // by slot, with 16-bit entries
+        IndexArray<uint64_t> list_blocks;       // for each 64 slots: the number of lists before them, a bit per list
+        IndexArray<uint64_t> list_offsets;
+        IndexArray<uint8_t> posting_bytes;
+        size_t num_total_postings;
+        size_t num_indexed_sketches;
+        uint64_t fingerprint;
+        std::shared_ptr<MappedFile> mapping;     // the saved index the arrays point into, if loaded
+
+        long slot_of(hash_t hash_value) const {
+            switch (key_layout) {
+                case KEYS_ELIAS_FANO:
+                    return elias_fano_keys.find(hash_value);
+                case KEYS_MPHF:
+                    return mphf_keys.find(hash_value);
+                case KEYS_DIRECTORY:
+                    return directory_keys.find(hash_value);
+                case KEYS_DIRECTORY_32:
+                    return narrow_directory_keys.find(hash_value);
+                case KEYS_SORTED_32:
+                    return narrow_sorted_keys.find(hash_value);
+                default:
+                    return sorted_keys.find(hash_value);
+            }
+        }
+
+        // take the contents of the index, the hashes in increasing order and their entries by rank
+        void set_contents(std::vector<hash_t>& hashes, std::vector<int32_t>& hash_entries,
+                            std::vector<uint64_t>& offsets, std::vector<uint8_t>& bytes,
+                            size_t num_postings, size_t num_sketches, uint64_t sketches_fingerprint);
+
+        void prefetch_keys(hash_t hash_value) const {
+            switch (key_layout) {
+                case KEYS_ELIAS_FANO:
+                    elias_fano_keys.prefetch(hash_value);
+                    break;
+                case KEYS_MPHF:
+                    mphf_keys.prefetch(hash_value);
+                    break;
+                case KEYS_DIRECTORY:
+                    directory_keys.prefetch(hash_value);
+                    break;
+                case KEYS_DIRECTORY_32:
+                    narrow_directory_keys.prefetch(hash_value);
+                    break;
+                case KEYS_SORTED_32:
+                    narrow_sorted_keys.prefetch(hash_value);
+                    break;
+                default:
+                    sorted_keys.prefetch(hash_value);
+            }
+        }
+
+        // the entry of a slot as with 32-bit entries: the only sketch index, or -list - 1
+        int32_t entry_of(long slot) const {
+            if (entry_bits == 32) {
+                return entries[slot];
+            }
+            const uint64_t* block = list_blocks.data() + 2 * (slot / 64);
+            uint64_t bit = (uint64_t)1 << (slot % 64);
+            if (block[1] & bit) {
+                return -(int32_t)(block[0] + __builtin_popcountll(block[1] & (bit - 1))) - 1;
+            }
+            return narrow_entries[slot];
+        }
+
+        void prefetch_entry(long slot) const {
+            if (entry_bits == 32) {
+                __builtin_prefetch(entries.data() + slot);
+            } else {
+                __builtin_prefetch(narrow_entries.data() + slot);
+                __builtin_prefetch(list_blocks.data() + 2 * (slot / 64));
+            }
+        }
+
+        // the posting list of a slot, nullptr if its only sketch index is kept in the entry
+        const uint8_t* list_of(long slot) const {
+            int32_t entry = entry_of(slot);
+            if (entry >= 0) {
+                return nullptr;
+            }
+            return posting_bytes.data() + list_offsets[-entry - 1];
+        }
+
+        PostingView view_of(long slot, const uint8_t* list) const {
+            if (list == nullptr) {
+                if (entry_bits == 32) {
+                    return PostingView(POSTINGS_RAW, 1, (const uint8_t*)(entries.data() + slot));
+                }
+                return PostingView(POSTINGS_RAW16, 1, (const uint8_t*)(narrow_entries.data() + slot));
+            }
+            PostingCodec list_codec = (PostingCodec)*list++;
+            size_t count = 0;
+            for (int shift = 0; ; shift += 7) {
+                count |= (size_t)(*list & 0x7f) << shift;
+                if ((*list++ & 0x80) == 0) {
+                    break;
+                }
+            }
+            return PostingView(list_codec, count, list);
+        }
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef INDEXFILE_H
+#define INDEXFILE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+
+/*
+Saved indexes are written as a sequence of fields, each starting at an 8-byte
+aligned offset (little endian):
+    value       one scalar, padded to 8 bytes
+    array       uint64 count, then count elements, padded to a multiple of 8 bytes
+A saved index is memory mapped and its arrays are used in place: the reader
+only checks the sizes and hands out pointers into the mapping.
+*/
+
+
+
+/**
+ * @brief A read-only array of an index, owned by the array or a view into a mapped index file.
+ */
+template <class T>
+class IndexArray {
+    public:
+        IndexArray() : view(nullptr), count(0) {}
+
+        IndexArray(const IndexArray& other) {
+            *this = other;
+        }
+
+        IndexArray& operator=(const IndexArray& other) {
+            owned = other.owned;
+            view = other.owns_values() ? owned.data() : other.view;
+            count = other.count;
+            return *this;
+        }
+
+        /**
+         * @brief Take the contents of a vector.
+         */
+        void assign(std::vector<T>& values) {
+            owned.swap(values);
+            owned.shrink_to_fit();
+            std::vector<T>().swap(values);
+            view = owned.data();
+            count = owned.size();
+        }
+
+        /**
+         * @brief Use values owned by someone else (a mapped index file), which must outlive the array.
+         */
+        void map(const T* values, size_t num_values) {
+            std::vector<T>().swap(owned);
+            view = values;
+            count = num_values;
+        }
+
+        void clear() {
+            std::vector<T>().swap(owned);
+            view = nullptr;
+            count = 0;
+        }
+
+        const T* data() const { return view; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const T* begin() const { return view; }
+        const T* end() const { return view + count; }
+        const T& back() const { return view[count - 1]; }
+        const T& operator[](size_t i) const { return view[i]; }
+
+    private:
+        std::vector<T> owned;
+        const T* view;
+        size_t count;
+
+        bool owns_values() const {
+            return !owned.empty() || view == nullptr;
+        }
+};
+
+
+
+/**
+ * @brief Writes the fields of an index to a file.
+ */
+class IndexFileWriter {
+    public:
+        IndexFileWriter(std::ostream& file) : file(file), streamed_size(0) {}
+
+        template <class T>
+        void write_value(const T& value) {
+            static_assert(sizeof(T) <= 8, "index file values take at most 8 bytes");
+            char field[8] = {0};
+            memcpy(field, &value, sizeof(T));
+            file.write(field, 8);
+        }
+
+        template <class T>
+        void write_array(const T* values, size_t count) {
+            write_value((uint64_t)count);
+            file.write((const char*)values, count * sizeof(T));
+            write_padding(count * sizeof(T));
+        }
+
+        template <class T>
+        void write_array(const IndexArray<T>& values) {
+            write_array(values.data(), values.size());
+        }
+
+        template <class T>
+        void write_array(const std::vector<T>& values) {
+            write_array(values.data(), values.size());
+        }
+
+        /**
+         * @brief Start an array of count elements, which are then written with write_elements.
+         */
+        void begin_array(size_t count) {
+            write_value((uint64_t)count);
+            streamed_size = 0;
+        }
+
+        template <class T>
+        void write_elements(const T* values, size_t count) {
+            file.write((const char*)values, count * sizeof(T));
+            streamed_size += count * sizeof(T);
+        }
+
+        /**
+         * @brief End an array started with begin_array.
+         */
+        void end_array() {
+            write_padding(streamed_size);
+            streamed_size = 0;
+        }
+
+    private:
+        std::ostream& file;
+        size_t streamed_size;
+
+        void write_padding(size_t size) {
+            static const char zeros[8] = {0};
+            file.write(zeros, (8 - size % 8) % 8);
+        }
+};
+
+
+
+/**
+ * @brief Reads the fields of a mapped index file, in the order they were written.
+ *
+ * Every read returns false (and reads nothing) once the data is too short.
+ */
+class IndexFileReader {
+    public:
+        IndexFileReader(const char* data, size_t size) : data(data), size(size), position(0) {}
+
+        template <class T>
+        bool read_value(T& value) {
+            static_assert(sizeof(T) <= 8, "index file values take at most 8 bytes");
+            if (size - position < 8) {
+                return false;
+            }
+            memcpy(&value, data + position, sizeof(T));
+            position += 8;
+            return true;
+        }
+
+        template <class T>
+        bool read_array(IndexArray<T>& values) {
+            uint64_t count;
+            if (!read_value(count) || count > (size - position) / sizeof(T)) {
+                return false;
+            }
+            values.map((const T*)(data + position), count);
+            position += (count * sizeof(T) + 7) & ~(size_t)7;
+            position = position > size ? size : position;
+            return true;
+        }
+
+        template <class T>
+        bool read_array(std::vector<T>& values) {
+            IndexArray<T> mapped_values;
+            if (!read_array(mapped_values)) {
+                return false;
+            }
+            values.assign(mapped_values.begin(), mapped_values.end());
+            return true;
+        }
+
+        size_t offset() const {
+            return position;
+        }
+
+    private:
+        const char* data;
+        size_t size;
+        size_t position;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "Inflater.h"
+
+#include <stdexcept>
+#include <cstring>
+
+
+// inflated bytes are produced in blocks of this size
+static const size_t INFLATE_CHUNK_SIZE = 1 << 16;
+
+// gzip inflates as deflate with a gzip header and trailer
+static const int GZIP_WINDOW_BITS = 15 + 16;
+static const int RAW_DEFLATE_WINDOW_BITS = -15;
+
+
+Inflater::Inflater(Format format) {
+    this->format = format;
+    this->stream_finished = false;
+    memset(&stream, 0, sizeof(stream));
+    int window_bits = (format == GZIP) ? GZIP_WINDOW_BITS : RAW_DEFLATE_WINDOW_BITS;
+    if (inflateInit2(&stream, window_bits) != Z_OK) {
+        throw std::runtime_error("Could not initialize zlib");
+    }
+}
+
+
+Inflater::~Inflater() {
+    inflateEnd(&stream);
+}
+
+
+bool Inflater::inflate(const char* data, size_t size, std::string& output) {
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = 0;
+
+    while (size > 0 || stream.avail_in > 0) {
+        // zlib counts bytes in 32 bits, feed large buffers piece by piece
+        if (stream.avail_in == 0) {
+            size_t feed = size < (1u << 30) ? size : (1u << 30);
+            stream.next_in = (Bytef*)data;
+            stream.avail_in = feed;
+            data += feed;
+            size -= feed;
+        }
+
+        if (stream_finished) {
+            // concatenated gzip members are allowed, anything else after the end is not
+            if (format != GZIP || inflateReset(&stream) != Z_OK) {
+                return false;
+            }
+            stream_finished = false;
+        }
+
+        size_t old_size = output.size();
+        output.resize(old_size + INFLATE_CHUNK_SIZE);
+        stream.next_out = (Bytef*)&output[old_size];
+        stream.avail_out = INFLATE_CHUNK_SIZE;
+
+        int status = ::inflate(&stream, Z_NO_FLUSH);
+        output.resize(old_size + INFLATE_CHUNK_SIZE - stream.avail_out);
+
+        if (status == Z_STREAM_END) {
+            stream_finished = true;
+        } else if (status != Z_OK && status != Z_BUF_ERROR) {
+            return false;
+        } else if (status == Z_BUF_ERROR && stream.avail_in == 0 && size == 0) {
+            break;
+        }
+    }
+    return true;
+}
+
+
+
+bool is_gzip(const char* data, size_t size) {
+    return size >= 2 && (unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b;
+}
+
+
+
+bool inflate_buffer(const char* data, size_t size, Inflater::Format format, 
+                    std::string& output, size_t size_hint) {
+    output.clear();
+    if (size_hint == 0 && format == Inflater::GZIP && size >= 4) {
+        // the gzip trailer holds the inflated size (mod 2^32) of the last member
+        uint32_t inflated_size;
+        memcpy(&inflated_size, data + size - 4, 4);
+        // deflate cannot compress better than about 1:1032, ignore larger (corrupt) sizes
+        if (inflated_size / 1032 <= size) {
+            size_hint = inflated_size;
+        }
+    }
+    output.reserve(size_hint + INFLATE_CHUNK_SIZE);
+
+    Inflater inflater(format);
+    if (!inflater.inflate(data, size, output)) {
+        return false;
+    }
+    return inflater.finished();
+}
@@ -0,0 +1,76 @@
+#ifndef INFLATER_H
+#define INFLATER_H
+
+#include <string>
+#include <cstddef>
+
+#include <zlib.h>
+
+
+/**
+ * @brief Streaming zlib decompressor for gzip and raw deflate data.
+ * 
+ * Compressed bytes can be fed in chunks of any size, the inflated bytes are
+ * appended to the output as they become available.
+ */
+class Inflater {
+    public:
+        enum Format {
+            GZIP,           // gzip members, as in .sig.gz files
+            RAW_DEFLATE     // bare deflate stream, as in zip members
+        };
+
+        Inflater(Format format);
+        ~Inflater();
+
+        Inflater(const Inflater&) = delete;
+        Inflater& operator=(const Inflater&) = delete;
+
+        /**
+         * @brief Inflate a chunk of compressed data.
+         * 
+         * @param data The compressed bytes.
+         * @param size The number of compressed bytes.
+         * @param output The string to append the inflated bytes to.
+         * @return true If the chunk was inflated.
+         * @return false If the data is corrupt.
+         */
+        bool inflate(const char* data, size_t size, std::string& output);
+
+        /**
+         * @brief Check if the end of the compressed stream has been reached.
+         */
+        bool finished() const {
+            return this->stream_finished;
+        }
+
+    private:
+        z_stream stream;
+        Format format;
+        bool stream_finished;
+};
+
+
+
+/**
+ * @brief Check if a buffer starts with the gzip magic bytes.
+ */
+bool is_gzip(const char* data, size_t size);
+
+
+
+/**
+ * @brief Inflate a whole compressed buffer.
+ * 
+ * @param data The compressed bytes.
+ * @param size The number of compressed bytes.
+ * @param format The format of the compressed bytes.
+ * @param output The string to store the inflated bytes in.
+ * @param size_hint The expected inflated size (0 if unknown).
+ * @return true If the buffer was inflated completely.
+ * @return false If the data is corrupt or truncated.
+ */
+bool inflate_buffer(const char* data, size_t size, Inflater::Format format, 
+                    std::string& output, size_t size_hint = 0);
+
+#endif
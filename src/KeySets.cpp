@@ -0,0 +1,489 @@
+#include "KeySets.h"
+
+#include <algorithm>
+
+
+// position of the k-th (from 0) set bit of a word
+static inline int select_in_word(uint64_t word, size_t k) {
+    for (size_t i = 0; i < k; i++) {
+        word &= word - 1;
+    }
+    return __builtin_ctzll(word);
+}
+
+
+
+void NarrowSortedKeySet::build(std::vector<hash_t>& sorted_keys) {
+    low_halves.clear();
+    buckets.clear();
+    if (sorted_keys.empty()) {
+        return;
+    }
+    ranks_per_value = sorted_keys.size() / ((double)sorted_keys.back() + 1);
+
+    std::vector<uint64_t> bucket_starts((sorted_keys.back() >> 32) + 2, 0);
+    std::vector<uint32_t> key_low_halves(sorted_keys.size());
+    for (size_t i = 0; i < sorted_keys.size(); i++) {
+        bucket_starts[(sorted_keys[i] >> 32) + 1]++;
+        key_low_halves[i] = (uint32_t)sorted_keys[i];
+    }
+    for (size_t b = 1; b < bucket_starts.size(); b++) {
+        bucket_starts[b] += bucket_starts[b - 1];
+    }
+    std::vector<hash_t>().swap(sorted_keys);
+    low_halves.assign(key_low_halves);
+    buckets.assign(bucket_starts);
+}
+
+
+
+void NarrowSortedKeySet::save(IndexFileWriter& writer) const {
+    writer.write_array(low_halves);
+    writer.write_array(buckets);
+    writer.write_value(ranks_per_value);
+}
+
+
+
+bool NarrowSortedKeySet::load(IndexFileReader& reader) {
+    if (!reader.read_array(low_halves) || !reader.read_array(buckets) || !reader.read_value(ranks_per_value)) {
+        return false;
+    }
+    return low_halves.empty() ? buckets.empty() : buckets.size() >= 2 && buckets.back() == low_halves.size();
+}
+
+
+
+template <class Remainder>
+BasicDirectoryKeySet<Remainder>::BasicDirectoryKeySet() {
+    this->shift = 0;
+    this->num_buckets = 0;
+    this->ranks_per_value = 0;
+}
+
+
+
+template <class Remainder>
+void BasicDirectoryKeySet<Remainder>::build(std::vector<hash_t>& sorted_keys) {
+    remainders.clear();
+    directory.clear();
+    num_buckets = 0;
+    shift = shift_for(sorted_keys);
+    if (sorted_keys.empty()) {
+        return;
+    }
+    ranks_per_value = sorted_keys.size() / ((double)sorted_keys.back() + 1);
+    num_buckets = (sorted_keys.back() >> shift) + 1;
+
+    std::vector<uint64_t> bucket_starts(num_buckets + 1, 0);
+    std::vector<Remainder> key_remainders(sorted_keys.size());
+    for (size_t i = 0; i < sorted_keys.size(); i++) {
+        hash_t bucket = sorted_keys[i] >> shift;
+        bucket_starts[bucket + 1]++;
+        key_remainders[i] = (Remainder)(sorted_keys[i] - (bucket << shift));
+    }
+    for (hash_t b = 0; b < num_buckets; b++) {
+        bucket_starts[b + 1] += bucket_starts[b];
+    }
+    std::vector<hash_t>().swap(sorted_keys);
+    remainders.assign(key_remainders);
+    directory.assign(bucket_starts);
+}
+
+
+
+template <class Remainder>
+void BasicDirectoryKeySet<Remainder>::save(IndexFileWriter& writer) const {
+    writer.write_array(remainders);
+    writer.write_array(directory);
+    writer.write_value(shift);
+    writer.write_value(num_buckets);
+    writer.write_value(ranks_per_value);
+}
+
+
+
+template <class Remainder>
+bool BasicDirectoryKeySet<Remainder>::load(IndexFileReader& reader) {
+    if (!reader.read_array(remainders) || !reader.read_array(directory) || !reader.read_value(shift)
+            || !reader.read_value(num_buckets) || !reader.read_value(ranks_per_value)) {
+        return false;
+    }
+    if (shift < 0 || shift > 8 * (int)sizeof(Remainder)) {
+        return false;
+    }
+    return remainders.empty() ? num_buckets == 0 : directory.size() == num_buckets + 1;
+}
+
+
+
+template class BasicDirectoryKeySet<uint64_t>;
+template class BasicDirectoryKeySet<uint32_t>;
+
+
+
+EliasFanoKeySet::EliasFanoKeySet() {
+    this->num_keys = 0;
+    this->low_bits = 0;
+    this->num_buckets = 0;
+}
+
+
+
+void EliasFanoKeySet::build(std::vector<hash_t>& sorted_keys) {
+    num_keys = sorted_keys.size();
+    high_words.clear();
+    low_words.clear();
+    zero_samples.clear();
+    if (num_keys == 0) {
+        low_bits = 0;
+        num_buckets = 0;
+        return;
+    }
+
+    hash_t keys_per_value = sorted_keys.back() / num_keys;
+    low_bits = keys_per_value == 0 ? 0 : 63 - __builtin_clzll(keys_per_value);
+    num_buckets = (sorted_keys.back() >> low_bits) + 1;
+
+    size_t num_high_bits = num_keys + num_buckets;
+    std::vector<uint64_t> high(num_high_bits / 64 + 1, 0);
+    std::vector<uint64_t> low_parts((num_keys * low_bits) / 64 + 2, 0);
+    hash_t low_mask = low_bits == 0 ? 0 : (~(hash_t)0 >> (64 - low_bits));
+    for (size_t i = 0; i < num_keys; i++) {
+        size_t position = (sorted_keys[i] >> low_bits) + i;
+        high[position / 64] |= (uint64_t)1 << (position % 64);
+        if (low_bits > 0) {
+            size_t bit = i * low_bits;
+            hash_t low = sorted_keys[i] & low_mask;
+            low_parts[bit / 64] |= low << (bit % 64);
+            if (bit % 64 + low_bits > 64) {
+                low_parts[bit / 64 + 1] |= low >> (64 - bit % 64);
+            }
+        }
+    }
+
+    // sample the positions of zeros 0, ZERO_SAMPLE_RATE, 2 * ZERO_SAMPLE_RATE, ...
+    std::vector<uint64_t> samples;
+    size_t num_zeros = 0;
+    size_t next_sample = 0;
+    for (size_t word_index = 0; word_index < high.size(); word_index++) {
+        uint64_t zeros = ~high[word_index];
+        size_t bits_in_word = std::min((size_t)64, num_high_bits - word_index * 64);
+        if (bits_in_word < 64) {
+            zeros &= ((uint64_t)1 << bits_in_word) - 1;
+        }
+        size_t count = __builtin_popcountll(zeros);
+        while (next_sample < num_zeros + count) {
+            samples.push_back(word_index * 64 + select_in_word(zeros, next_sample - num_zeros));
+            next_sample += ZERO_SAMPLE_RATE;
+        }
+        num_zeros += count;
+    }
+
+    high_words.assign(high);
+    low_words.assign(low_parts);
+    zero_samples.assign(samples);
+}
+
+
+
+size_t EliasFanoKeySet::get_keys(KeyCursor& cursor, hash_t* keys, size_t max_count) const {
+    // key i is the i-th set bit of the high bits: its high part is its position minus i
+    size_t count = 0;
+    size_t position = cursor.position;
+    while (count < max_count && cursor.rank < num_keys) {
+        size_t word_index = position / 64;
+        uint64_t word = high_words[word_index] & (~(uint64_t)0 << (position % 64));
+        while (word == 0) {
+            word = high_words[++word_index];
+        }
+        position = word_index * 64 + __builtin_ctzll(word);
+        keys[count++] = ((hash_t)(position - cursor.rank) << low_bits) | low_part(cursor.rank);
+        cursor.rank++;
+        position++;
+    }
+    cursor.position = position;
+    return count;
+}
+
+
+
+void EliasFanoKeySet::save(IndexFileWriter& writer) const {
+    writer.write_value((uint64_t)num_keys);
+    writer.write_value(low_bits);
+    writer.write_value((uint64_t)num_buckets);
+    writer.write_array(high_words);
+    writer.write_array(low_words);
+    writer.write_array(zero_samples);
+}
+
+
+
+bool EliasFanoKeySet::load(IndexFileReader& reader) {
+    uint64_t saved_num_keys;
+    uint64_t saved_num_buckets;
+    if (!reader.read_value(saved_num_keys) || !reader.read_value(low_bits) || !reader.read_value(saved_num_buckets)
+            || !reader.read_array(high_words) || !reader.read_array(low_words) || !reader.read_array(zero_samples)) {
+        return false;
+    }
+    num_keys = saved_num_keys;
+    num_buckets = saved_num_buckets;
+    return num_keys == 0 || high_words.size() == (num_keys + num_buckets) / 64 + 1;
+}
+
+
+
+hash_t EliasFanoKeySet::low_part(size_t i) const {
+    if (low_bits == 0) {
+        return 0;
+    }
+    size_t bit = i * low_bits;
+    hash_t low = low_words[bit / 64] >> (bit % 64);
+    if (bit % 64 + low_bits > 64) {
+        low |= low_words[bit / 64 + 1] << (64 - bit % 64);
+    }
+    return low & (~(hash_t)0 >> (64 - low_bits));
+}
+
+
+
+size_t EliasFanoKeySet::select_zero(size_t k) const {
+    size_t position = zero_samples[k / ZERO_SAMPLE_RATE];
+    size_t remaining = k % ZERO_SAMPLE_RATE;
+    size_t word_index = position / 64;
+    uint64_t zeros = ~high_words[word_index] & (~(uint64_t)0 << (position % 64));
+    while (true) {
+        size_t count = __builtin_popcountll(zeros);
+        if (remaining < count) {
+            return word_index * 64 + select_in_word(zeros, remaining);
+        }
+        remaining -= count;
+        word_index++;
+        zeros = ~high_words[word_index];
+    }
+}
+
+
+
+long EliasFanoKeySet::find(hash_t hash_value) const {
+    hash_t high = hash_value >> low_bits;
+    if (num_keys == 0 || high >= num_buckets) {
+        return -1;
+    }
+    hash_t low = low_bits == 0 ? 0 : hash_value & (~(hash_t)0 >> (64 - low_bits));
+
+    // the keys with this high part are the ones between the zeros ending buckets high - 1 and high
+    size_t position = (high == 0) ? 0 : select_zero(high - 1) + 1;
+    size_t rank = position - high;
+    while (high_bit(position)) {
+        hash_t key_low = low_part(rank);
+        if (key_low == low) {
+            return rank;
+        }
+        if (key_low > low) {
+            return -1;
+        }
+        position++;
+        rank++;
+    }
+    return -1;
+}
+
+
+
+void EliasFanoKeySet::prefetch(hash_t hash_value) const {
+    hash_t high = hash_value >> low_bits;
+    if (num_keys == 0 || high >= num_buckets || high == 0) {
+        return;
+    }
+    // the sample find starts from, and where the keys of the bucket should be if the keys are uniform
+    size_t rank_guess = (size_t)((double)high * num_keys / num_buckets);
+    __builtin_prefetch(zero_samples.data() + (high - 1) / ZERO_SAMPLE_RATE);
+    __builtin_prefetch(high_words.data() + std::min(high_words.size() - 1, (size_t)(high + rank_guess) / 64));
+    __builtin_prefetch(low_words.data() + std::min(low_words.size() - 1, rank_guess * low_bits / 64));
+}
+
+
+
+
+// a 64-bit mixer (the finalizer of splitmix64)
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+
+MphfKeySet::MphfKeySet() {
+    this->num_keys = 0;
+    this->num_level_keys = 0;
+}
+
+
+
+size_t MphfKeySet::position_in_level(hash_t hash_value, int level, size_t level_size) {
+    uint64_t h = mix64(hash_value + 0x9E3779B97F4A7C15ULL * (level + 1));
+    return (size_t)(((unsigned __int128)h * level_size) >> 64);
+}
+
+
+
+uint16_t MphfKeySet::fingerprint_of(hash_t hash_value) {
+    return mix64(hash_value ^ 0x5bd1e9955bd1e995ULL) >> 48;
+}
+
+
+
+size_t MphfKeySet::rank(size_t position) const {
+    size_t block = position / RANK_SAMPLE_BITS;
+    size_t result = rank_samples[block];
+    for (size_t word = block * (RANK_SAMPLE_BITS / 64); word < position / 64; word++) {
+        result += __builtin_popcountll(bits[word]);
+    }
+    uint64_t mask = ((uint64_t)1 << (position % 64)) - 1;
+    return result + __builtin_popcountll(bits[position / 64] & mask);
+}
+
+
+
+void MphfKeySet::build(std::vector<hash_t>& sorted_keys) {
+    num_keys = sorted_keys.size();
+    std::vector<uint64_t> level_bits;
+    std::vector<uint64_t> offsets(1, 0);
+    std::vector<uint64_t> samples;
+
+    std::vector<hash_t> keys = sorted_keys;
+    std::vector<uint64_t> seen;
+    std::vector<uint64_t> collided;
+    for (int level = 0; level < MAX_LEVELS && !keys.empty(); level++) {
+        // one bit per key, rounded up to whole words
+        size_t level_words = (keys.size() + 63) / 64;
+        size_t level_size = level_words * 64;
+        seen.assign(level_words, 0);
+        collided.assign(level_words, 0);
+        for (hash_t key : keys) {
+            size_t position = position_in_level(key, level, level_size);
+            uint64_t bit = (uint64_t)1 << (position % 64);
+            if (seen[position / 64] & bit) {
+                collided[position / 64] |= bit;
+            } else {
+                seen[position / 64] |= bit;
+            }
+        }
+        for (size_t w = 0; w < level_words; w++) {
+            level_bits.push_back(seen[w] & ~collided[w]);
+        }
+        offsets.push_back(offsets.back() + level_size);
+
+        // the keys which collided are placed by the next level
+        size_t num_left = 0;
+        for (hash_t key : keys) {
+            size_t position = position_in_level(key, level, level_size);
+            if (collided[position / 64] & ((uint64_t)1 << (position % 64))) {
+                keys[num_left++] = key;
+            }
+        }
+        keys.resize(num_left);
+    }
+    std::sort(keys.begin(), keys.end());
+    fallback_keys.assign(keys);
+
+    // pad to whole rank blocks, and count the kept bits before each block
+    level_bits.resize((level_bits.size() * 64 + RANK_SAMPLE_BITS - 1) / RANK_SAMPLE_BITS * (RANK_SAMPLE_BITS / 64) + 1, 0);
+    size_t ones = 0;
+    for (size_t w = 0; w < level_bits.size(); w++) {
+        if (w % (RANK_SAMPLE_BITS / 64) == 0) {
+            samples.push_back(ones);
+        }
+        ones += __builtin_popcountll(level_bits[w]);
+    }
+    num_level_keys = ones;
+    bits.assign(level_bits);
+    level_offsets.assign(offsets);
+    rank_samples.assign(samples);
+
+    // the fallback keys collided at every level, they reach no kept bit and need no fingerprint
+    std::vector<uint16_t> slot_fingerprints(num_level_keys, 0);
+    for (hash_t key : sorted_keys) {
+        long slot = slot_in_levels(key);
+        if (slot >= 0) {
+            slot_fingerprints[slot] = fingerprint_of(key);
+        }
+    }
+    fingerprints.assign(slot_fingerprints);
+}
+
+
+
+void MphfKeySet::save(IndexFileWriter& writer) const {
+    writer.write_value((uint64_t)num_keys);
+    writer.write_value((uint64_t)num_level_keys);
+    writer.write_array(bits);
+    writer.write_array(level_offsets);
+    writer.write_array(rank_samples);
+    writer.write_array(fingerprints);
+    writer.write_array(fallback_keys);
+}
+
+
+
+bool MphfKeySet::load(IndexFileReader& reader) {
+    uint64_t saved_num_keys;
+    uint64_t saved_num_level_keys;
+    if (!reader.read_value(saved_num_keys) || !reader.read_value(saved_num_level_keys)
+            || !reader.read_array(bits) || !reader.read_array(level_offsets) || !reader.read_array(rank_samples)
+            || !reader.read_array(fingerprints) || !reader.read_array(fallback_keys)) {
+        return false;
+    }
+    num_keys = saved_num_keys;
+    num_level_keys = saved_num_level_keys;
+    return num_keys == 0 || (!level_offsets.empty() && level_offsets.back() <= bits.size() * 64
+                                && fingerprints.size() == num_level_keys);
+}
+
+
+
+// the slot of a hash value among the keys placed by the levels, -1 if it reaches no kept bit
+long MphfKeySet::slot_in_levels(hash_t hash_value) const {
+    for (size_t level = 0; level + 1 < level_offsets.size(); level++) {
+        size_t level_size = level_offsets[level + 1] - level_offsets[level];
+        size_t position = level_offsets[level] + position_in_level(hash_value, level, level_size);
+        if ((bits[position / 64] >> (position % 64)) & 1) {
+            return rank(position);
+        }
+    }
+    return -1;
+}
+
+
+
+long MphfKeySet::find(hash_t hash_value) const {
+    if (num_keys == 0) {
+        return -1;
+    }
+    long slot = slot_in_levels(hash_value);
+    if (slot >= 0) {
+        return fingerprints[slot] == fingerprint_of(hash_value) ? slot : -1;
+    }
+    auto it = std::lower_bound(fallback_keys.begin(), fallback_keys.end(), hash_value);
+    if (it == fallback_keys.end() || *it != hash_value) {
+        return -1;
+    }
+    return num_level_keys + (it - fallback_keys.begin());
+}
+
+
+
+void MphfKeySet::prefetch(hash_t hash_value) const {
+    if (num_keys == 0) {
+        return;
+    }
+    // most keys are placed by the first level
+    size_t position = position_in_level(hash_value, 0, level_offsets[1]);
+    __builtin_prefetch(bits.data() + position / 64);
+    __builtin_prefetch(rank_samples.data() + position / RANK_SAMPLE_BITS);
+}
@@ -0,0 +1,407 @@
+#ifndef KEYSETS_H
+#define KEYSETS_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include "IndexFile.h"
+
+#ifndef HASH_T
+#define HASH_T
+typedef unsigned long long int hash_t;
+#endif
+
+
+/*
+Key sets hold the distinct hash values of a FrozenSketchIndex. They are built
+once from the sorted keys, and map a hash value to its slot: the position at
+which the index stores the posting list of that hash, or -1 if the hash value
+is not in the set. The slots of n keys are 0 to n - 1; for the sorted layouts
+the slot of a key is its rank, otherwise the index orders its entries by slot.
+
+Every key set provides:
+    void build(std::vector<hash_t>& sorted_keys)     (may take the contents of the vector)
+    long find(hash_t hash_value) const
+    void prefetch(hash_t hash_value) const           (a hint: start loading what find will read)
+    size_t size() const
+    size_t memory_usage() const
+    void save(IndexFileWriter& writer) const
+    bool load(IndexFileReader& reader)              (the arrays are used in place, see IndexFile.h)
+
+The sets which store their keys (all but MphfKeySet) also list them by slot:
+    size_t get_keys(KeyCursor& cursor, hash_t* keys, size_t max_count) const
+        (writes up to max_count keys from the cursor on, returns how many)
+*/
+
+
+
+/**
+ * @brief Where a listing of the keys of a key set stands (see get_keys).
+ */
+struct KeyCursor {
+    size_t rank;        // the next key to list
+    size_t position;    // where that key is in the key set (its bit in the high bits, for Elias-Fano)
+
+    KeyCursor() : rank(0), position(0) {}
+};
+
+
+
+/**
+ * @brief The keys as a plain sorted array, the slot of a key is its rank.
+ */
+class SortedKeySet {
+    public:
+        SortedKeySet() : ranks_per_value(0) {}
+
+        void build(std::vector<hash_t>& sorted_keys) {
+            keys.assign(sorted_keys);
+            ranks_per_value = keys.empty() ? 0 : keys.size() / ((double)keys.back() + 1);
+        }
+
+        long find(hash_t hash_value) const {
+            auto it = std::lower_bound(keys.begin(), keys.end(), hash_value);
+            if (it == keys.end() || *it != hash_value) {
+                return -1;
+            }
+            return it - keys.begin();
+        }
+
+        // the keys are uniform, so the rank of a hash value is close to hash_value * ranks_per_value
+        void prefetch(hash_t hash_value) const {
+            if (!keys.empty()) {
+                size_t guess = std::min(keys.size() - 1, (size_t)(hash_value * ranks_per_value));
+                __builtin_prefetch(keys.data() + guess);
+            }
+        }
+
+        size_t size() const {
+            return keys.size();
+        }
+
+        size_t memory_usage() const {
+            return keys.size() * sizeof(hash_t);
+        }
+
+        size_t get_keys(KeyCursor& cursor, hash_t* listed_keys, size_t max_count) const {
+            size_t count = std::min(max_count, keys.size() - std::min(cursor.rank, keys.size()));
+            std::copy(keys.begin() + cursor.rank, keys.begin() + cursor.rank + count, listed_keys);
+            cursor.rank += count;
+            return count;
+        }
+
+        void save(IndexFileWriter& writer) const {
+            writer.write_array(keys);
+            writer.write_value(ranks_per_value);
+        }
+
+        bool load(IndexFileReader& reader) {
+            return reader.read_array(keys) && reader.read_value(ranks_per_value);
+        }
+
+    private:
+        IndexArray<hash_t> keys;
+        double ranks_per_value;
+};
+
+
+
+/**
+ * @brief The keys as their sorted low 32 bits, grouped by their high 32 bits; the slot of a key is its rank.
+ *
+ * The keys whose high half is b are stored from buckets[b] on, as their low
+ * halves. When the largest key has few high halves for the number of keys (a
+ * large scaled, or many keys), this halves the keys of a SortedKeySet for a
+ * small bucket array, and a lookup binary searches a single bucket.
+ */
+class NarrowSortedKeySet {
+    public:
+        NarrowSortedKeySet() : ranks_per_value(0) {}
+
+        /**
+         * @brief Check if there are at least MIN_KEYS_PER_BUCKET keys per high half, up to the largest key.
+         */
+        static bool fits(const std::vector<hash_t>& sorted_keys) {
+            return !sorted_keys.empty() 
+                    && ((sorted_keys.back() >> 32) + 1) * MIN_KEYS_PER_BUCKET <= sorted_keys.size();
+        }
+
+        void build(std::vector<hash_t>& sorted_keys);
+
+        long find(hash_t hash_value) const {
+            hash_t bucket = hash_value >> 32;
+            if (bucket + 1 >= buckets.size()) {
+                return -1;
+            }
+            const uint32_t* first = low_halves.data() + buckets[bucket];
+            const uint32_t* last = low_halves.data() + buckets[bucket + 1];
+            const uint32_t* it = std::lower_bound(first, last, (uint32_t)hash_value);
+            if (it == last || *it != (uint32_t)hash_value) {
+                return -1;
+            }
+            return it - low_halves.data();
+        }
+
+        void prefetch(hash_t hash_value) const {
+            hash_t bucket = hash_value >> 32;
+            if (bucket + 1 >= buckets.size()) {
+                return;
+            }
+            __builtin_prefetch(buckets.data() + bucket);
+            size_t guess = std::min(low_halves.size() - 1, (size_t)(hash_value * ranks_per_value));
+            __builtin_prefetch(low_halves.data() + guess);
+        }
+
+        size_t size() const {
+            return low_halves.size();
+        }
+
+        size_t memory_usage() const {
+            return low_halves.size() * sizeof(uint32_t) + buckets.size() * sizeof(uint64_t);
+        }
+
+        // cursor.position is the bucket of the key at cursor.rank
+        size_t get_keys(KeyCursor& cursor, hash_t* listed_keys, size_t max_count) const {
+            size_t count = std::min(max_count, low_halves.size() - std::min(cursor.rank, low_halves.size()));
+            for (size_t i = 0; i < count; i++, cursor.rank++) {
+                while (buckets[cursor.position + 1] <= cursor.rank) cursor.position++;
+                listed_keys[i] = ((hash_t)cursor.position << 32) | low_halves[cursor.rank];
+            }
+            return count;
+        }
+
+        void save(IndexFileWriter& writer) const;
+
+        bool load(IndexFileReader& reader);
+
+    private:
+        // the bucket array takes at most 0.5 bytes per key
+        static const size_t MIN_KEYS_PER_BUCKET = 16;
+
+        IndexArray<uint32_t> low_halves;
+        IndexArray<uint64_t> buckets;       // rank of the first key of each high half, and the number of keys
+        double ranks_per_value;
+};
+
+
+
+/**
+ * @brief The keys as a sorted array with a directory on their top bits, the slot of a key is its rank.
+ *
+ * Hash values are uniform below their max_hash, so the keys whose top bits
+ * (key >> shift) are b, for the bucket b, sit at a predictable place in the
+ * array: directory[b] is the rank of the first of them. With about two keys
+ * per bucket, a lookup reads one directory entry and then guesses the rank by
+ * interpolation inside the bucket, and is almost always right or one off.
+ *
+ * The top bits of a key are those of its bucket, so only the remainder
+ * key - (b << shift) is stored, in a Remainder. A 32-bit Remainder halves the
+ * keys, and holds them when shift <= 32: when the largest key has at most
+ * about 33 + log2(number of keys) bits (a large scaled, or many keys).
+ */
+template <class Remainder>
+class BasicDirectoryKeySet {
+    public:
+        BasicDirectoryKeySet();
+
+        /**
+         * @brief Check if the remainders of the keys fit in a Remainder (see build).
+         */
+        static bool fits(const std::vector<hash_t>& sorted_keys) {
+            return shift_for(sorted_keys) <= 8 * (int)sizeof(Remainder);
+        }
+
+        void build(std::vector<hash_t>& sorted_keys);
+
+        long find(hash_t hash_value) const {
+            hash_t bucket = hash_value >> shift;
+            if (bucket >= num_buckets) {
+                return -1;
+            }
+            size_t first = directory[bucket];
+            size_t last = directory[bucket + 1];
+            if (first == last) {
+                return -1;
+            }
+            // interpolate the position of the hash value in [first, last) from its offset in the bucket
+            hash_t offset_in_bucket = hash_value - (bucket << shift);
+            Remainder remainder = (Remainder)offset_in_bucket;
+            size_t position = first + (size_t)(((unsigned __int128)offset_in_bucket * (last - first)) >> shift);
+            if (remainders[position] < remainder) {
+                while (++position < last && remainders[position] < remainder);
+            } else {
+                while (position > first && remainders[position - 1] >= remainder) position--;
+            }
+            if (position < last && remainders[position] == remainder) {
+                return position;
+            }
+            return -1;
+        }
+
+        void prefetch(hash_t hash_value) const {
+            hash_t bucket = hash_value >> shift;
+            if (bucket >= num_buckets) {
+                return;
+            }
+            __builtin_prefetch(directory.data() + bucket);
+            size_t guess = std::min(remainders.size() - 1, (size_t)(hash_value * ranks_per_value));
+            __builtin_prefetch(remainders.data() + guess);
+        }
+
+        size_t size() const {
+            return remainders.size();
+        }
+
+        size_t memory_usage() const {
+            return remainders.size() * sizeof(Remainder) + directory.size() * sizeof(uint64_t);
+        }
+
+        // cursor.position is the bucket of the key at cursor.rank
+        size_t get_keys(KeyCursor& cursor, hash_t* listed_keys, size_t max_count) const {
+            size_t count = std::min(max_count, remainders.size() - std::min(cursor.rank, remainders.size()));
+            for (size_t i = 0; i < count; i++, cursor.rank++) {
+                while (directory[cursor.position + 1] <= cursor.rank) cursor.position++;
+                listed_keys[i] = ((hash_t)cursor.position << shift) + remainders[cursor.rank];
+            }
+            return count;
+        }
+
+        void save(IndexFileWriter& writer) const;
+
+        bool load(IndexFileReader& reader);
+
+    private:
+        IndexArray<Remainder> remainders;  // the keys less the top bits of their bucket
+        IndexArray<uint64_t> directory;    // rank of the first key of each bucket, and the number of keys
+        int shift;
+        hash_t num_buckets;
+        double ranks_per_value;
+
+        // about two keys per bucket: 2^(log2(n) - 1) buckets over the bits of the largest key
+        static int shift_for(const std::vector<hash_t>& sorted_keys) {
+            if (sorted_keys.empty()) {
+                return 0;
+            }
+            int key_bits = sorted_keys.back() == 0 ? 0 : 64 - __builtin_clzll(sorted_keys.back());
+            int bucket_bits = std::max(1, 63 - __builtin_clzll(sorted_keys.size()) - 1);
+            return std::max(0, key_bits - bucket_bits);
+        }
+};
+
+typedef BasicDirectoryKeySet<uint64_t> DirectoryKeySet;
+typedef BasicDirectoryKeySet<uint32_t> NarrowDirectoryKeySet;
+
+
+
+/**
+ * @brief The keys in Elias-Fano encoding, the slot of a key is its rank.
+ *
+ * Each key is split into its low low_bits bits, stored packed, and its high
+ * part, stored in unary in a bit vector: key i sets bit (key >> low_bits) + i.
+ * With low_bits about log2(max key / number of keys), this takes about
+ * 2 + low_bits bits per key instead of 64. A lookup selects the start of the
+ * bucket of its high part (sampled select on the zeros of the bit vector) and
+ * compares the low parts of the (few) keys in that bucket.
+ */
+class EliasFanoKeySet {
+    public:
+        EliasFanoKeySet();
+
+        void build(std::vector<hash_t>& sorted_keys);
+
+        long find(hash_t hash_value) const;
+
+        void prefetch(hash_t hash_value) const;
+
+        size_t size() const {
+            return num_keys;
+        }
+
+        size_t memory_usage() const {
+            return (high_words.size() + low_words.size() + zero_samples.size()) * sizeof(uint64_t);
+        }
+
+        size_t get_keys(KeyCursor& cursor, hash_t* keys, size_t max_count) const;
+
+        void save(IndexFileWriter& writer) const;
+
+        bool load(IndexFileReader& reader);
+
+    private:
+        // every ZERO_SAMPLE_RATE-th zero of the high bits has its position sampled
+        static const size_t ZERO_SAMPLE_RATE = 256;
+
+        size_t num_keys;
+        int low_bits;
+        size_t num_buckets;         // number of distinct high parts (zeros in the high bits)
+        IndexArray<uint64_t> high_words;
+        IndexArray<uint64_t> low_words;
+        IndexArray<uint64_t> zero_samples;
+
+        bool high_bit(size_t position) const {
+            return (high_words[position / 64] >> (position % 64)) & 1;
+        }
+
+        hash_t low_part(size_t i) const;
+        size_t select_zero(size_t k) const;
+};
+
+
+
+
+/**
+ * @brief The keys through a minimal perfect hash function, the keys themselves are not stored.
+ *
+ * BBHash construction: at each level, every remaining key is hashed into a bit
+ * array with one bit per key. Bits hit by exactly one key are kept, the keys
+ * which collided go to the next level. After MAX_LEVELS levels the few keys left
+ * are kept explicitly. The slot of a key is the rank of its bit among all kept
+ * bits (about 3 bits per key with the rank samples).
+ *
+ * Absent hash values are rejected by a 16-bit fingerprint stored per slot, so a 
+ * hash value not in the set is taken for a key with probability 2^-16.
+ */
+class MphfKeySet {
+    public:
+        MphfKeySet();
+
+        void build(std::vector<hash_t>& sorted_keys);
+
+        long find(hash_t hash_value) const;
+
+        void prefetch(hash_t hash_value) const;
+
+        size_t size() const {
+            return num_keys;
+        }
+
+        size_t memory_usage() const {
+            return (bits.size() + rank_samples.size()) * sizeof(uint64_t) + fingerprints.size() * sizeof(uint16_t)
+                    + fallback_keys.size() * sizeof(hash_t);
+        }
+
+        void save(IndexFileWriter& writer) const;
+
+        bool load(IndexFileReader& reader);
+
+    private:
+        static const int MAX_LEVELS = 32;
+        static const size_t RANK_SAMPLE_BITS = 512;
+
+        size_t num_keys;
+        IndexArray<uint64_t> bits;              // the kept bits of all levels, back to back
+        IndexArray<uint64_t> level_offsets;     // first bit of each level, and the end of the last one
+        IndexArray<uint64_t> rank_samples;      // number of kept bits before each block of RANK_SAMPLE_BITS
+        IndexArray<uint16_t> fingerprints;      // by slot
+        IndexArray<hash_t> fallback_keys;       // sorted keys left after the last level, slots after all bits
+        size_t num_level_keys;
+
+        static size_t position_in_level(hash_t hash_value, int level, size_t level_size);
+        static uint16_t fingerprint_of(hash_t hash_value);
+        size_t rank(size_t position) const;
+        long slot_in_levels(hash_t hash_value) const;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "MappedFile.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+MappedFile::MappedFile() {
+    this->mapped_data = nullptr;
+    this->mapped_size = 0;
+    this->opened = false;
+}
+
+
+MappedFile::MappedFile(const std::string& file_path, bool sequential) : MappedFile() {
+    open(file_path, sequential);
+}
+
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+
+bool MappedFile::open(const std::string& file_path, bool sequential) {
+    close();
+
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t file_size = file_stat.st_size;
+    if (file_size > 0) {
+        void* addr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        madvise(addr, file_size, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+        this->mapped_data = (const char*)addr;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    this->mapped_size = file_size;
+    this->opened = true;
+    return true;
+}
+
+
+void MappedFile::close() {
+    if (this->mapped_data != nullptr) {
+        munmap((void*)this->mapped_data, this->mapped_size);
+    }
+    this->mapped_data = nullptr;
+    this->mapped_size = 0;
+    this->opened = false;
+}
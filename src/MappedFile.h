@@ -0,0 +1,55 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+
+/**
+ * @brief Read-only memory mapping of a whole file.
+ * 
+ * The mapping is released when the object is destroyed.
+ */
+class MappedFile {
+    public:
+        MappedFile();
+        MappedFile(const std::string& file_path, bool sequential = true);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /**
+         * @brief Map a file into memory.
+         * 
+         * @param file_path The path to the file.
+         * @param sequential Whether the file will be read front to back (enables aggressive readahead).
+         * @return true If the file was mapped (an empty file is mapped with size 0).
+         * @return false If the file could not be opened or mapped.
+         */
+        bool open(const std::string& file_path, bool sequential = true);
+
+        /**
+         * @brief Release the mapping.
+         */
+        void close();
+
+        bool is_open() const {
+            return this->opened;
+        }
+
+        const char* data() const {
+            return this->mapped_data;
+        }
+
+        size_t size() const {
+            return this->mapped_size;
+        }
+
+    private:
+        const char* mapped_data;
+        size_t mapped_size;
+        bool opened;
+};
+
+#endif
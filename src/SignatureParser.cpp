@@ -0,0 +1,428 @@
+#include "SignatureParser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+
+hash_t max_hash_for_scaled(int scaled) {
+    if (scaled <= 1) {
+        return 0;
+    }
+    // same floating point computation as sourmash, round(MAX_HASH / scaled), so that the hashes kept match
+    // (nearbyint rounds half to even, as Python's round does)
+    return (hash_t)std::nearbyint((double)~(hash_t)0 / (double)scaled);
+}
+
+
+SignatureSaxHandler::SignatureSaxHandler(std::vector<Sketch>& sketches, const std::string& file_path, 
+                                        const SketchLoadOptions& options, int first_signature_index) 
+                                        : sketches(sketches), file_path(file_path), options(options) {
+    this->num_sketches_before = sketches.size();
+    this->first_signature_index = first_signature_index;
+    this->max_hash_limit = max_hash_for_scaled(options.scaled);
+    this->max_value = this->max_hash_limit == 0 ? ~(hash_t)0 : this->max_hash_limit;
+    this->buffer = nullptr;
+    this->buffer_end = nullptr;
+    this->mins_spans = nullptr;
+    this->reset();
+}
+
+
+void SignatureSaxHandler::use_mins_spans(const char* buffer, const char* buffer_end, 
+                                        const std::vector<std::pair<size_t, size_t>>* mins_spans) {
+    this->buffer = buffer;
+    this->buffer_end = buffer_end;
+    this->mins_spans = mins_spans;
+}
+
+
+void SignatureSaxHandler::reset() {
+    this->sketches.resize(this->num_sketches_before);
+    this->depth = 0;
+    this->record_key.clear();
+    this->signature_key.clear();
+    this->record_name.clear();
+    this->record_first_sketch = this->num_sketches_before;
+    this->signature = Sketch();
+    this->signature_mins_span = -1;
+    this->buffer = nullptr;
+    this->buffer_end = nullptr;
+    this->mins_spans = nullptr;
+    this->mins_span_failed = false;
+    this->num_signatures = 0;
+}
+
+
+bool SignatureSaxHandler::start_object(std::size_t) {
+    depth++;
+    if (depth == 2) {
+        record_key.clear();
+        record_name.clear();
+        record_first_sketch = sketches.size();
+    } else if (depth == 4 && record_key == "signatures") {
+        signature_key.clear();
+        signature = Sketch();
+        signature.signature_index = first_signature_index + num_signatures;
+        if (options.lazy_metadata) {
+            signature.metadata_loaded = false;
+        } else {
+            signature.file_path = file_path;
+        }
+        signature_mins_span = -1;
+    }
+    return true;
+}
+
+
+bool SignatureSaxHandler::end_object() {
+    if (depth == 4 && record_key == "signatures") {
+        num_signatures++;
+        if (!finish_signature()) {
+            return false;
+        }
+    } else if (depth == 2 && !options.lazy_metadata) {
+        // the name may come after the signatures in the record
+        for (size_t i = record_first_sketch; i < sketches.size(); i++) {
+            sketches[i].name = record_name;
+        }
+    }
+    depth--;
+    return true;
+}
+
+
+bool SignatureSaxHandler::finish_signature() {
+    if (!keep_signature()) {
+        return true;
+    }
+    if (signature_mins_span >= 0 && !options.metadata_only) {
+        const auto& span = (*mins_spans)[signature_mins_span];
+        if (!parse_hash_list(buffer + span.first, buffer + span.second, buffer_end, signature.hashes, max_value)) {
+            mins_span_failed = true;
+            return false;
+        }
+    }
+    if (max_hash_limit != 0 && (signature.max_hash == 0 || signature.max_hash > max_hash_limit)) {
+        signature.max_hash = max_hash_limit;
+    }
+    sketches.push_back(std::move(signature));
+    return true;
+}
+
+
+bool SignatureSaxHandler::start_array(std::size_t) {
+    depth++;
+    return true;
+}
+
+
+bool SignatureSaxHandler::end_array() {
+    depth--;
+    return true;
+}
+
+
+bool SignatureSaxHandler::key(json::string_t& value) {
+    if (depth == 2) {
+        record_key = value;
+    } else if (depth == 4) {
+        signature_key = value;
+    }
+    return true;
+}
+
+
+bool SignatureSaxHandler::string(json::string_t& value) {
+    if (options.lazy_metadata) {
+        return true;
+    }
+    if (depth == 2 && record_key == "name") {
+        record_name = std::move(value);
+    } else if (depth == 4 && in_signature() && signature_key == "md5sum") {
+        signature.md5 = std::move(value);
+    }
+    return true;
+}
+
+
+bool SignatureSaxHandler::number(hash_t value) {
+    if (!in_signature()) {
+        return true;
+    }
+    if (depth == 5 && signature_key == "mins") {
+        if (mins_spans == nullptr) {
+            if (!options.metadata_only && value <= max_value) {
+                signature.hashes.push_back(value);
+            }
+            return true;
+        }
+        // the value is the id of the span holding the mins, decoded once we know the signature is kept
+        if (value >= mins_spans->size()) {
+            mins_span_failed = true;
+            return false;
+        }
+        signature_mins_span = value;
+    } else if (depth == 4) {
+        if (signature_key == "ksize") {
+            signature.ksize = (int)value;
+        } else if (signature_key == "max_hash") {
+            signature.max_hash = value;
+        } else if (signature_key == "seed") {
+            signature.seed = (int)value;
+        }
+    }
+    return true;
+}
+
+
+bool SignatureSaxHandler::parse_error(std::size_t, const std::string&, const json::exception& ex) {
+    if (mins_spans != nullptr) {
+        // the text with the mins cut out did not parse, let the caller retry on the plain text
+        mins_span_failed = true;
+        return false;
+    }
+    throw std::runtime_error(std::string("Could not parse the signature: ") + ex.what());
+}
+
+
+
+
+static inline bool is_json_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+
+
+// parse up to 20 digits in [p, p + num_digits), false on overflow
+static inline bool parse_digits_scalar(const char* p, int num_digits, hash_t& value) {
+    hash_t result = 0;
+    for (int i = 0; i < num_digits; i++) {
+        hash_t digit = p[i] - '0';
+        if (__builtin_mul_overflow(result, (hash_t)10, &result) || __builtin_add_overflow(result, digit, &result)) {
+            return false;
+        }
+    }
+    value = result;
+    return true;
+}
+
+
+
+static bool parse_hash_list_scalar(const char* p, const char* end, std::vector<hash_t>& hashes, hash_t max_value) {
+    while (true) {
+        while (p < end && is_json_space(*p)) p++;
+        if (p == end) {
+            return true;
+        }
+        const char* digits_start = p;
+        while (p < end && *p >= '0' && *p <= '9') p++;
+        int num_digits = p - digits_start;
+        hash_t value;
+        if (num_digits == 0 || num_digits > 20 || !parse_digits_scalar(digits_start, num_digits, value)) {
+            return false;
+        }
+        if (value <= max_value) {
+            hashes.push_back(value);
+        }
+        while (p < end && is_json_space(*p)) p++;
+        if (p == end) {
+            return true;
+        }
+        if (*p != ',') {
+            return false;
+        }
+        p++;
+    }
+}
+
+
+
+#ifdef HAVE_X86_SIMD
+
+// shuffle masks which right-align the first n bytes of a 16 byte register, zero filling the front
+struct RightAlignMasks {
+    alignas(16) unsigned char masks[17][16];
+    RightAlignMasks() {
+        for (int n = 0; n <= 16; n++) {
+            for (int i = 0; i < 16; i++) {
+                int src = i - (16 - n);
+                masks[n][i] = (src < 0) ? 0x80 : (unsigned char)src;
+            }
+        }
+    }
+};
+
+static const RightAlignMasks right_align_masks;
+
+
+
+// value of the 16 digits (as 0..9 bytes, most significant first) in a register
+__attribute__((target("sse4.1")))
+static inline hash_t digits_to_value_sse(__m128i digits) {
+    const __m128i mul_10 = _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1);
+    const __m128i mul_100 = _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1);
+    const __m128i mul_10000 = _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1);
+    __m128i pairs = _mm_maddubs_epi16(digits, mul_10);
+    __m128i quads = _mm_madd_epi16(pairs, mul_100);
+    __m128i packed = _mm_packus_epi32(quads, quads);
+    __m128i octs = _mm_madd_epi16(packed, mul_10000);
+    hash_t high = (uint32_t)_mm_cvtsi128_si32(octs);
+    hash_t low = (uint32_t)_mm_extract_epi32(octs, 1);
+    return high * 100000000ULL + low;
+}
+
+
+
+__attribute__((target("sse4.1")))
+static bool parse_hash_list_sse(const char* p, const char* end, const char* buffer_end, std::vector<hash_t>& hashes, 
+                                hash_t max_value) {
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+
+    while (true) {
+        while (p < end && is_json_space(*p)) p++;
+        if (p == end) {
+            return true;
+        }
+
+        // need 32 readable bytes for up to 16 digits past a 4 digit prefix, else finish in scalar
+        if (buffer_end - p < 32) {
+            return parse_hash_list_scalar(p, end, hashes, max_value);
+        }
+
+        __m128i chunk = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)p), zero_char);
+        __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(chunk, nine), chunk);
+        unsigned int digit_mask = _mm_movemask_epi8(is_digit);
+        int num_digits = __builtin_ctz(~digit_mask);  // 16 if all bytes are digits
+
+        hash_t value;
+        if (num_digits == 0) {
+            return false;
+        } else if (num_digits < 16) {
+            __m128i mask = _mm_load_si128((const __m128i*)right_align_masks.masks[num_digits]);
+            value = digits_to_value_sse(_mm_shuffle_epi8(chunk, mask));
+        } else {
+            // 16 to 20 digits: a short scalar prefix and the last 16 digits in the register
+            const char* q = p + 16;
+            while (q < end && *q >= '0' && *q <= '9' && q - p <= 20) q++;
+            num_digits = q - p;
+            if (num_digits > 20) {
+                return false;
+            }
+            int prefix_digits = num_digits - 16;
+            hash_t prefix = 0;
+            parse_digits_scalar(p, prefix_digits, prefix);
+            __m128i last16 = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(p + prefix_digits)), zero_char);
+            hash_t suffix = digits_to_value_sse(last16);
+            if (__builtin_mul_overflow(prefix, 10000000000000000ULL, &value) || __builtin_add_overflow(value, suffix, &value)) {
+                return false;
+            }
+        }
+        if (value <= max_value) {
+            hashes.push_back(value);
+        }
+        p += num_digits;
+
+        while (p < end && is_json_space(*p)) p++;
+        if (p == end) {
+            return true;
+        }
+        if (*p != ',') {
+            return false;
+        }
+        p++;
+    }
+}
+
+#endif
+
+
+
+bool parse_hash_list(const char* begin, const char* end, const char* buffer_end, std::vector<hash_t>& hashes, 
+                        hash_t max_value) {
+    // when values are dropped the number kept is unknown, let the vector grow
+    if (max_value == ~(hash_t)0) {
+        hashes.reserve(hashes.size() + std::count(begin, end, ',') + 1);
+    }
+#ifdef HAVE_X86_SIMD
+    static const bool has_sse41 = __builtin_cpu_supports("sse4.1");
+    if (has_sse41) {
+        return parse_hash_list_sse(begin, end, buffer_end, hashes, max_value);
+    }
+#endif
+    return parse_hash_list_scalar(begin, end, hashes, max_value);
+}
+
+
+
+// find the contents of all "mins" arrays in the text
+static void find_mins_spans(const char* data, size_t size, std::vector<std::pair<size_t, size_t>>& spans) {
+    const char* end = data + size;
+    const char* p = data;
+    const char key[] = "\"mins\"";
+    const size_t key_length = sizeof(key) - 1;
+
+    while (p < end) {
+        const char* found = (const char*)memmem(p, end - p, key, key_length);
+        if (found == nullptr) {
+            return;
+        }
+        p = found + key_length;
+
+        // an escaped quote means we are inside a string
+        size_t num_backslashes = 0;
+        while (found - num_backslashes > data && *(found - num_backslashes - 1) == '\\') num_backslashes++;
+        if (num_backslashes % 2 == 1) {
+            continue;
+        }
+
+        const char* q = p;
+        while (q < end && is_json_space(*q)) q++;
+        if (q == end || *q != ':') continue;
+        q++;
+        while (q < end && is_json_space(*q)) q++;
+        if (q == end || *q != '[') continue;
+        q++;
+
+        const char* close = (const char*)memchr(q, ']', end - q);
+        if (close == nullptr) {
+            return;
+        }
+        spans.push_back(std::make_pair(q - data, close - data));
+        p = close + 1;
+    }
+}
+
+
+
+void parse_signature_buffer(const char* data, size_t size, SignatureSaxHandler& handler) {
+    std::vector<std::pair<size_t, size_t>> mins_spans;
+    find_mins_spans(data, size, mins_spans);
+
+    if (!mins_spans.empty()) {
+        // the text without the mins, each mins array holds only the id of its span
+        std::string skeleton;
+        size_t previous_end = 0;
+        for (size_t i = 0; i < mins_spans.size(); i++) {
+            skeleton.append(data + previous_end, mins_spans[i].first - previous_end);
+            skeleton.append(std::to_string(i));
+            previous_end = mins_spans[i].second;
+        }
+        skeleton.append(data + previous_end, size - previous_end);
+
+        handler.use_mins_spans(data, data + size, &mins_spans);
+        nlohmann::json::sax_parse(skeleton, &handler);
+        if (!handler.mins_span_failed) {
+            return;
+        }
+        handler.reset();
+    }
+
+    nlohmann::json::sax_parse(data, data + size, &handler);
+}
@@ -0,0 +1,183 @@
+#ifndef SIGNATUREPARSER_H
+#define SIGNATUREPARSER_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <utility>
+
+#include "json.hpp"
+#include "Sketch.h"
+
+
+#ifndef HASH_T
+#define HASH_T
+typedef unsigned long long int hash_t;
+#endif
+
+
+/**
+ * @brief Which signatures to keep when reading signature files, and how to read them.
+ */
+struct SketchLoadOptions {
+    int ksize = 0;              // keep only signatures with this ksize, 0 keeps all
+    int seed = -1;              // keep only signatures with this seed, -1 keeps all
+    int scaled = 0;             // downsample to this scaled (drop hashes above its max_hash), 0 keeps all hashes
+    bool largest_first = false; // read_sketches: read the largest files first (costs a stat per file)
+    int io_threads = 0;         // read_sketches: threads reading files ahead of the parser threads, 0: none
+    bool lazy_metadata = false; // keep no name, md5 or path, fetch them later with load_sketch_metadata
+    bool metadata_only = false; // skip the hashes, keep only the metadata
+};
+
+
+
+/**
+ * @brief The max_hash of a sketch with the given scaled (as computed by sourmash).
+ * 
+ * @param scaled The scaled value.
+ * @return hash_t The largest hash kept at this scaled, 0 (no limit) if scaled is at most 1.
+ */
+hash_t max_hash_for_scaled(int scaled);
+
+
+
+/**
+ * @brief SAX handler for sourmash signature files.
+ * 
+ * The handler walks the json events of a signature file and keeps only the
+ * fields we need, so that no json DOM is built while reading. The mins are
+ * written directly into the hashes of the resulting sketches.
+ * 
+ * Expected layout: 
+ * [ { "name": ..., "signatures": [ { "ksize": ..., "seed": ..., "max_hash": ..., 
+ *                                    "mins": [...], "md5sum": ... }, ... ] }, ... ]
+ * 
+ * Every signature of every record which passes the load options becomes one
+ * Sketch, appended in file order. Each sketch records the position of its 
+ * signature among all signatures of the file (signature_index), so that its
+ * metadata can be found again when it is loaded lazily.
+ * 
+ * When the mins arrays have been located in the raw text beforehand (see 
+ * parse_signature_buffer), each of them is replaced by its span id in the text
+ * given to the parser, and the handler decodes the span directly instead, only
+ * for the signatures that are kept.
+ * 
+ * With options.scaled set, the hashes above the max_hash of that scaled are 
+ * dropped while decoding, and the max_hash of the sketch is lowered accordingly.
+ */
+class SignatureSaxHandler {
+    public:
+        using json = nlohmann::json;
+
+        SignatureSaxHandler(std::vector<Sketch>& sketches, const std::string& file_path, 
+                            const SketchLoadOptions& options, int first_signature_index = 0);
+
+        /**
+         * @brief Decode the mins from spans of the raw text instead of the json events.
+         * 
+         * @param buffer The raw text of the signature file.
+         * @param buffer_end The end of the raw text.
+         * @param mins_spans The [begin, end) offsets of the contents of the mins arrays.
+         */
+        void use_mins_spans(const char* buffer, const char* buffer_end, 
+                            const std::vector<std::pair<size_t, size_t>>* mins_spans);
+
+        /**
+         * @brief Forget everything read so far (including sketches already appended).
+         */
+        void reset();
+
+        // set when a mins span could not be decoded, the caller should parse the plain text instead
+        bool mins_span_failed;
+
+        // the number of signatures seen so far, kept or not
+        int num_signatures;
+
+        // json SAX interface
+        bool null() { return true; }
+        bool boolean(bool) { return true; }
+        bool number_integer(json::number_integer_t value) { return number((hash_t)value); }
+        bool number_unsigned(json::number_unsigned_t value) { return number((hash_t)value); }
+        bool number_float(json::number_float_t value, const json::string_t&) { return number((hash_t)value); }
+        bool string(json::string_t& value);
+        bool binary(json::binary_t&) { return true; }
+        bool start_object(std::size_t);
+        bool end_object();
+        bool start_array(std::size_t);
+        bool end_array();
+        bool key(json::string_t& value);
+        bool parse_error(std::size_t, const std::string&, const json::exception& ex);
+
+    private:
+        std::vector<Sketch>& sketches;
+        const std::string& file_path;
+        const SketchLoadOptions& options;
+        size_t num_sketches_before;
+        int first_signature_index;
+        hash_t max_hash_limit;      // largest hash kept, from options.scaled (0: no limit)
+        hash_t max_value;           // largest hash kept, as a plain bound
+
+        // nesting level: 1 = list of records, 2 = record, 3 = list of signatures, 
+        // 4 = signature, 5 = mins
+        int depth;
+        std::string record_key;
+        std::string signature_key;
+
+        // the record and signature being read
+        std::string record_name;
+        size_t record_first_sketch;
+        Sketch signature;
+        long signature_mins_span;
+
+        const char* buffer;
+        const char* buffer_end;
+        const std::vector<std::pair<size_t, size_t>>* mins_spans;
+
+        bool in_signature() {
+            return depth >= 4 && record_key == "signatures";
+        }
+
+        bool keep_signature() {
+            return (options.ksize == 0 || signature.ksize == options.ksize) 
+                    && (options.seed == -1 || signature.seed == options.seed);
+        }
+
+        bool number(hash_t value);
+        bool finish_signature();
+};
+
+
+
+/**
+ * @brief Decode a comma separated list of unsigned 64-bit integers.
+ * 
+ * Uses an SSE4.1 digit parsing kernel when the CPU supports it, and a scalar
+ * loop otherwise. Whitespace around the numbers is allowed.
+ * 
+ * @param begin The start of the list (just after the '[').
+ * @param end The end of the list (the position of the ']').
+ * @param buffer_end The end of the readable memory, used to allow 16-byte loads past end.
+ * @param hashes The vector to append the values to.
+ * @param max_value Values above this one are checked but not appended.
+ * @return true If the list was decoded.
+ * @return false If the list contains anything other than unsigned integers.
+ */
+bool parse_hash_list(const char* begin, const char* end, const char* buffer_end, std::vector<hash_t>& hashes, 
+                        hash_t max_value = ~(hash_t)0);
+
+
+/**
+ * @brief Parse a signature file held in memory.
+ * 
+ * Fast path: the "mins" arrays are located by a text scan and decoded with 
+ * parse_hash_list, only the remaining (small) text goes through the SAX parser.
+ * If the fast path is not applicable, the whole text is SAX parsed.
+ * 
+ * @param data The contents of the signature file.
+ * @param size The size of the contents.
+ * @param handler The handler which receives the fields.
+ */
+void parse_signature_buffer(const char* data, size_t size, SignatureSaxHandler& handler);
+
+#endif
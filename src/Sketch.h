@@ -1,10 +1,13 @@
 // a sketch is a vector of hash_t, sorted in ascending order
 // other attributes are: file path, and name
+// the hashes are either owned by the sketch, or a view into a mapped sketch store
 
 
 # include <iostream>
 # include <vector>
 # include <string>
+# include <utility>
+# include <memory>
 
 
 #ifndef HASH_T
@@ -26,15 +29,48 @@ class Sketch {
         hash_t max_hash;
         int seed;
 
+        // when the hashes live in a mapped sketch store instead of the vector above
+        const hash_t* mapped_hashes;
+        size_t num_mapped_hashes;
+        std::shared_ptr<const void> mapping;
+
+        // where the sketch came from: index into the list of sketch paths, and position
+        // of its signature among all signatures of that file (used to load metadata lazily)
+        int path_index;
+        int signature_index;
+        bool metadata_loaded;
+
 
         Sketch(std::vector<hash_t> hashes, std::string file_path, std::string name, std::string md5, int ksize, hash_t max_hash, int seed) {
-            this->hashes = hashes;
-            this->file_path = file_path;
-            this->name = name;
-            this->md5 = md5;
+            this->hashes = std::move(hashes);
+            this->file_path = std::move(file_path);
+            this->name = std::move(name);
+            this->md5 = std::move(md5);
             this->ksize = ksize;
             this->max_hash = max_hash;
             this->seed = seed;
+            this->mapped_hashes = nullptr;
+            this->num_mapped_hashes = 0;
+            this->path_index = -1;
+            this->signature_index = -1;
+            this->metadata_loaded = true;
+        }
+
+        // a view on hashes kept alive by the mapping
+        Sketch(const hash_t* mapped_hashes, size_t num_mapped_hashes, std::shared_ptr<const void> mapping,
+                std::string file_path, std::string name, std::string md5, int ksize, hash_t max_hash, int seed) {
+            this->mapped_hashes = mapped_hashes;
+            this->num_mapped_hashes = num_mapped_hashes;
+            this->mapping = std::move(mapping);
+            this->file_path = std::move(file_path);
+            this->name = std::move(name);
+            this->md5 = std::move(md5);
+            this->ksize = ksize;
+            this->max_hash = max_hash;
+            this->seed = seed;
+            this->path_index = -1;
+            this->signature_index = -1;
+            this->metadata_loaded = true;
         }
 
         Sketch() {
@@ -45,6 +81,11 @@ class Sketch {
             this->ksize = 0;
             this->max_hash = 0;
             this->seed = 0;
+            this->mapped_hashes = nullptr;
+            this->num_mapped_hashes = 0;
+            this->path_index = -1;
+            this->signature_index = -1;
+            this->metadata_loaded = true;
         }
 
         // copy constructor
@@ -56,8 +97,34 @@ class Sketch {
             this->ksize = sketch.ksize;
             this->max_hash = sketch.max_hash;
             this->seed = sketch.seed;
+            this->mapped_hashes = sketch.mapped_hashes;
+            this->num_mapped_hashes = sketch.num_mapped_hashes;
+            this->mapping = sketch.mapping;
+            this->path_index = sketch.path_index;
+            this->signature_index = sketch.signature_index;
+            this->metadata_loaded = sketch.metadata_loaded;
         }
 
+        // move constructor
+        Sketch(Sketch&& sketch) noexcept {
+            this->hashes = std::move(sketch.hashes);
+            this->file_path = std::move(sketch.file_path);
+            this->name = std::move(sketch.name);
+            this->md5 = std::move(sketch.md5);
+            this->ksize = sketch.ksize;
+            this->max_hash = sketch.max_hash;
+            this->seed = sketch.seed;
+            this->mapped_hashes = sketch.mapped_hashes;
+            this->num_mapped_hashes = sketch.num_mapped_hashes;
+            this->mapping = std::move(sketch.mapping);
+            this->path_index = sketch.path_index;
+            this->signature_index = sketch.signature_index;
+            this->metadata_loaded = sketch.metadata_loaded;
+        }
+
+        Sketch& operator=(const Sketch& sketch) = default;
+        Sketch& operator=(Sketch&& sketch) noexcept = default;
+
         // destructor
         ~Sketch() {
             this->hashes.clear();
@@ -66,22 +133,38 @@ class Sketch {
         void show();
 
         void show_hashes() {
-            for (hash_t hash : this->hashes) {
+            for (hash_t hash : *this) {
                 std::cout << hash << " ";
             }
             std::cout << std::endl;
         }
 
-        size_t size() {
-            return this->hashes.size();
+        bool is_mapped() const {
+            return this->mapped_hashes != nullptr;
+        }
+
+        const hash_t* data() const {
+            return is_mapped() ? this->mapped_hashes : this->hashes.data();
+        }
+
+        size_t size() const {
+            return is_mapped() ? this->num_mapped_hashes : this->hashes.size();
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        const hash_t* begin() const {
+            return data();
         }
 
-        bool empty() {
-            return this->hashes.empty();
+        const hash_t* end() const {
+            return data() + size();
         }
 
-        hash_t operator[](int i) {
-            return this->hashes[i];
+        hash_t operator[](size_t i) const {
+            return data()[i];
         }
 
 };
@@ -0,0 +1,201 @@
+#include "SketchStore.h"
+#include "MappedFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+
+
+static size_t align_to_8(size_t offset) {
+    return (offset + 7) & ~(size_t)7;
+}
+
+static void write_padding(std::ofstream& file, size_t size) {
+    static const char zeros[8] = {0};
+    file.write(zeros, align_to_8(size) - size);
+}
+
+
+
+bool is_sketch_store(const char* data, size_t size) {
+    return size >= sizeof(PackedStoreHeader) && memcmp(data, PACKED_STORE_MAGIC, sizeof(PACKED_STORE_MAGIC)) == 0;
+}
+
+
+
+bool is_sketch_store_file(const std::string& file_path) {
+    std::ifstream file(file_path, std::ios::binary);
+    PackedStoreHeader header;
+    if (!file.read((char*)&header, sizeof(header))) {
+        return false;
+    }
+    return is_sketch_store((const char*)&header, sizeof(header));
+}
+
+
+
+bool write_sketch_store(const std::string& store_path, const std::vector<Sketch>& sketches) {
+    std::ofstream file(store_path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open the file: " << store_path << std::endl;
+        return false;
+    }
+
+    // build the sketch table and the string table
+    std::vector<PackedSketchRecord> records(sketches.size());
+    std::string strings;
+    uint64_t num_hashes = 0;
+    for (size_t i = 0; i < sketches.size(); i++) {
+        const Sketch& sketch = sketches[i];
+        PackedSketchRecord& record = records[i];
+        memset(&record, 0, sizeof(record));
+        record.first_hash = num_hashes;
+        record.num_hashes = sketch.size();
+        record.max_hash = sketch.max_hash;
+        record.ksize = sketch.ksize;
+        record.seed = sketch.seed;
+        if (std::is_sorted(sketch.begin(), sketch.end())) {
+            record.flags |= PACKED_SKETCH_SORTED;
+        }
+        record.name_offset = strings.size();
+        record.name_length = sketch.name.size();
+        strings += sketch.name;
+        record.md5_offset = strings.size();
+        record.md5_length = sketch.md5.size();
+        strings += sketch.md5;
+        record.path_offset = strings.size();
+        record.path_length = sketch.file_path.size();
+        strings += sketch.file_path;
+        num_hashes += sketch.size();
+    }
+
+    PackedStoreHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACKED_STORE_MAGIC, sizeof(PACKED_STORE_MAGIC));
+    header.version = PACKED_STORE_VERSION;
+    header.num_sketches = sketches.size();
+    header.num_hashes = num_hashes;
+    header.hashes_offset = align_to_8(sizeof(PackedStoreHeader));
+    header.sketch_table_offset = header.hashes_offset + num_hashes * sizeof(hash_t);
+    header.strings_offset = header.sketch_table_offset + records.size() * sizeof(PackedSketchRecord);
+    header.strings_size = strings.size();
+
+    file.write((const char*)&header, sizeof(header));
+    write_padding(file, sizeof(header));
+    for (const Sketch& sketch : sketches) {
+        file.write((const char*)sketch.data(), sketch.size() * sizeof(hash_t));
+    }
+    file.write((const char*)records.data(), records.size() * sizeof(PackedSketchRecord));
+    file.write(strings.data(), strings.size());
+    write_padding(file, strings.size());
+
+    file.close();
+    if (!file) {
+        std::cerr << "Could not write the sketch store: " << store_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+
+// map a store and check its header, nullptr if it is not a valid store
+static const PackedStoreHeader* map_sketch_store(const std::string& store_path, MappedFile& mapped_file) {
+    // the hashes are accessed at random later on, no sequential readahead
+    mapped_file.open(store_path, false);
+    const char* data = mapped_file.data();
+    size_t size = mapped_file.size();
+    if (!mapped_file.is_open() || !is_sketch_store(data, size)) {
+        return nullptr;
+    }
+
+    const PackedStoreHeader* header = (const PackedStoreHeader*)data;
+    if (header->version != PACKED_STORE_VERSION
+            || header->hashes_offset + header->num_hashes * sizeof(hash_t) > size
+            || header->sketch_table_offset + header->num_sketches * sizeof(PackedSketchRecord) > size
+            || header->strings_offset + header->strings_size > size) {
+        std::cerr << "Invalid sketch store: " << store_path << std::endl;
+        return nullptr;
+    }
+    return header;
+}
+
+
+
+bool read_sketch_store(const std::string& store_path, const SketchLoadOptions& options, 
+                        std::vector<Sketch>& sketches) {
+    std::shared_ptr<MappedFile> mapped_file = std::make_shared<MappedFile>();
+    const PackedStoreHeader* header = map_sketch_store(store_path, *mapped_file);
+    if (header == nullptr) {
+        return false;
+    }
+
+    const char* data = mapped_file->data();
+    const hash_t* hashes = (const hash_t*)(data + header->hashes_offset);
+    const PackedSketchRecord* records = (const PackedSketchRecord*)(data + header->sketch_table_offset);
+    const char* strings = data + header->strings_offset;
+
+    hash_t max_hash_limit = max_hash_for_scaled(options.scaled);
+    sketches.reserve(sketches.size() + header->num_sketches);
+    for (uint64_t i = 0; i < header->num_sketches; i++) {
+        const PackedSketchRecord& record = records[i];
+        if ((options.ksize != 0 && record.ksize != options.ksize) 
+                || (options.seed != -1 && record.seed != options.seed)) {
+            continue;
+        }
+        const hash_t* sketch_hashes = hashes + record.first_hash;
+        size_t num_hashes = options.metadata_only ? 0 : record.num_hashes;
+        hash_t max_hash = record.max_hash;
+        bool copy_hashes = false;
+        if (max_hash_limit != 0 && (max_hash == 0 || max_hash > max_hash_limit)) {
+            max_hash = max_hash_limit;
+            if (record.flags & PACKED_SKETCH_SORTED) {
+                num_hashes = std::upper_bound(sketch_hashes, sketch_hashes + num_hashes, max_hash) - sketch_hashes;
+            } else {
+                copy_hashes = true;
+            }
+        }
+        Sketch sketch;
+        if (copy_hashes) {
+            std::vector<hash_t> kept_hashes;
+            std::copy_if(sketch_hashes, sketch_hashes + num_hashes, std::back_inserter(kept_hashes), 
+                        [max_hash](hash_t hash) { return hash <= max_hash; });
+            sketch = Sketch(std::move(kept_hashes), "", "", "", record.ksize, max_hash, record.seed);
+        } else {
+            sketch = Sketch(sketch_hashes, num_hashes, mapped_file, "", "", "", record.ksize, max_hash, record.seed);
+        }
+        sketch.signature_index = i;
+        if (options.lazy_metadata) {
+            sketch.metadata_loaded = false;
+        } else {
+            sketch.file_path.assign(strings + record.path_offset, record.path_length);
+            sketch.name.assign(strings + record.name_offset, record.name_length);
+            sketch.md5.assign(strings + record.md5_offset, record.md5_length);
+        }
+        sketches.push_back(std::move(sketch));
+    }
+    return true;
+}
+
+
+
+bool read_sketch_store_metadata(const std::string& store_path, size_t sketch_index, Sketch& sketch) {
+    MappedFile mapped_file;
+    const PackedStoreHeader* header = map_sketch_store(store_path, mapped_file);
+    if (header == nullptr || sketch_index >= header->num_sketches) {
+        return false;
+    }
+
+    const char* data = mapped_file.data();
+    const PackedSketchRecord& record = ((const PackedSketchRecord*)(data + header->sketch_table_offset))[sketch_index];
+    const char* strings = data + header->strings_offset;
+    sketch.file_path.assign(strings + record.path_offset, record.path_length);
+    sketch.name.assign(strings + record.name_offset, record.name_length);
+    sketch.md5.assign(strings + record.md5_offset, record.md5_length);
+    sketch.ksize = record.ksize;
+    sketch.max_hash = record.max_hash;
+    sketch.seed = record.seed;
+    return true;
+}
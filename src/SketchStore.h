@@ -0,0 +1,115 @@
+#ifndef SKETCHSTORE_H
+#define SKETCHSTORE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Sketch.h"
+#include "SignatureParser.h"
+
+
+/*
+Packed sketch store: all the sketches of a collection in one binary file,
+which is memory mapped and used in place (no parsing).
+
+Layout (little endian, all sections 8-byte aligned):
+    header          PackedStoreHeader
+    hashes          uint64[num_hashes], the hashes of all sketches back to back
+    sketch table    PackedSketchRecord[num_sketches]
+    string table    names, md5s and paths back to back (not null terminated)
+*/
+
+const char PACKED_STORE_MAGIC[8] = {'S', 'M', 'S', 'K', 'P', 'A', 'C', 'K'};
+const uint32_t PACKED_STORE_VERSION = 1;
+
+struct PackedStoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t num_sketches;
+    uint64_t num_hashes;
+    uint64_t hashes_offset;
+    uint64_t sketch_table_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+};
+
+struct PackedSketchRecord {
+    uint64_t first_hash;        // index of the first hash in the hashes section
+    uint64_t num_hashes;
+    uint64_t max_hash;
+    int32_t ksize;
+    int32_t seed;
+    uint64_t name_offset;       // offsets into the string table
+    uint64_t md5_offset;
+    uint64_t path_offset;
+    uint32_t name_length;
+    uint32_t md5_length;
+    uint32_t path_length;
+    uint32_t flags;             // PACKED_SKETCH_* bits
+};
+
+const uint32_t PACKED_SKETCH_SORTED = 1;    // the hashes of the sketch are in increasing order
+
+
+
+/**
+ * @brief Check if a buffer holds a packed sketch store.
+ */
+bool is_sketch_store(const char* data, size_t size);
+
+
+
+/**
+ * @brief Check if a file is a packed sketch store.
+ */
+bool is_sketch_store_file(const std::string& file_path);
+
+
+
+/**
+ * @brief Write sketches to a packed sketch store.
+ * 
+ * @param store_path The path of the store to write.
+ * @param sketches The sketches to store.
+ * @return true If the store was written.
+ * @return false If the file could not be written.
+ */
+bool write_sketch_store(const std::string& store_path, const std::vector<Sketch>& sketches);
+
+
+
+/**
+ * @brief Load the sketches of a packed sketch store.
+ * 
+ * The store is memory mapped, the sketches are views on the mapped hashes and
+ * keep the mapping alive. Nothing is parsed or copied except the strings
+ * (not even those with options.lazy_metadata, see read_sketch_store_metadata).
+ * With options.scaled, sorted sketches are downsampled by shortening the view,
+ * the others are copied without the dropped hashes.
+ * 
+ * @param store_path The path of the store.
+ * @param options Which sketches to keep.
+ * @param sketches The vector to append the sketches to.
+ * @return true If the store was loaded.
+ * @return false If the file is not a valid store.
+ */
+bool read_sketch_store(const std::string& store_path, const SketchLoadOptions& options, 
+                        std::vector<Sketch>& sketches);
+
+
+
+
+/**
+ * @brief Read the name, md5 and path of one sketch of a packed sketch store.
+ * 
+ * @param store_path The path of the store.
+ * @param sketch_index The position of the sketch in the store (its signature_index).
+ * @param sketch The sketch to fill in (no hashes).
+ * @return true If the sketch was found.
+ * @return false If the file is not a valid store or has no such sketch.
+ */
+bool read_sketch_store_metadata(const std::string& store_path, size_t sketch_index, Sketch& sketch);
+
+#endif
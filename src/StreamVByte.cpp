@@ -0,0 +1,115 @@
+#include "StreamVByte.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+
+static inline int byte_length_code(uint32_t value) {
+    if (value < (1u << 8)) return 0;
+    if (value < (1u << 16)) return 1;
+    if (value < (1u << 24)) return 2;
+    return 3;
+}
+
+
+
+void streamvbyte_encode_deltas(const int* values, size_t num_values, std::vector<uint8_t>& output) {
+    size_t control_start = output.size();
+    output.resize(control_start + (num_values + 3) / 4, 0);
+    int previous = 0;
+    for (size_t i = 0; i < num_values; i++) {
+        uint32_t delta = values[i] - previous;
+        previous = values[i];
+        int code = byte_length_code(delta);
+        output[control_start + i / 4] |= code << (2 * (i % 4));
+        for (int b = 0; b <= code; b++) {
+            output.push_back((delta >> (8 * b)) & 0xff);
+        }
+    }
+}
+
+
+
+static void streamvbyte_decode_scalar(const uint8_t* control, const uint8_t*& data, size_t num_values,
+                                        int previous, int* output) {
+    for (size_t i = 0; i < num_values; i++) {
+        int code = (control[i / 4] >> (2 * (i % 4))) & 3;
+        uint32_t delta = 0;
+        for (int b = 0; b <= code; b++) {
+            delta |= (uint32_t)data[b] << (8 * b);
+        }
+        data += code + 1;
+        previous += delta;
+        output[i] = previous;
+    }
+}
+
+
+
+#ifdef HAVE_X86_SIMD
+
+// for each control byte: the shuffle which spreads its data bytes over 4 ints, and its number of data bytes
+struct StreamVByteTables {
+    alignas(16) unsigned char shuffles[256][16];
+    unsigned char lengths[256];
+    StreamVByteTables() {
+        for (int control = 0; control < 256; control++) {
+            int source = 0;
+            for (int i = 0; i < 4; i++) {
+                int length = ((control >> (2 * i)) & 3) + 1;
+                for (int b = 0; b < 4; b++) {
+                    shuffles[control][4 * i + b] = (b < length) ? (unsigned char)(source + b) : 0x80;
+                }
+                source += length;
+            }
+            lengths[control] = source;
+        }
+    }
+};
+
+static const StreamVByteTables streamvbyte_tables;
+
+
+
+__attribute__((target("ssse3")))
+static void streamvbyte_decode_ssse3(const uint8_t* control, const uint8_t*& data, size_t num_values,
+                                        int previous, int* output) {
+    __m128i running = _mm_set1_epi32(previous);
+    size_t num_groups = num_values / 4;
+    for (size_t g = 0; g < num_groups; g++) {
+        uint8_t control_byte = control[g];
+        __m128i bytes = _mm_loadu_si128((const __m128i*)data);
+        __m128i deltas = _mm_shuffle_epi8(bytes, _mm_load_si128((const __m128i*)streamvbyte_tables.shuffles[control_byte]));
+        // prefix sum of the 4 deltas, plus the last value of the previous group
+        deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 4));
+        deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 8));
+        running = _mm_add_epi32(deltas, _mm_shuffle_epi32(running, 0xff));
+        _mm_storeu_si128((__m128i*)(output + 4 * g), running);
+        data += streamvbyte_tables.lengths[control_byte];
+    }
+    size_t done = 4 * num_groups;
+    if (done < num_values) {
+        previous = (done == 0) ? previous : output[done - 1];
+        streamvbyte_decode_scalar(control + num_groups, data, num_values - done, previous, output + done);
+    }
+}
+
+#endif
+
+
+
+void streamvbyte_decode_deltas(const uint8_t* control, const uint8_t*& data, size_t num_values,
+                                int previous, int* output) {
+#ifdef HAVE_X86_SIMD
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    if (has_ssse3) {
+        streamvbyte_decode_ssse3(control, data, num_values, previous, output);
+        return;
+    }
+#endif
+    streamvbyte_decode_scalar(control, data, num_values, previous, output);
+}
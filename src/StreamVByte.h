@@ -0,0 +1,53 @@
+#ifndef STREAMVBYTE_H
+#define STREAMVBYTE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+/*
+StreamVByte encoding of increasing lists of non-negative ints (Lemire et al.).
+
+The differences between consecutive values (the first value is kept as is) are
+written with 1 to 4 bytes each. The byte lengths of each group of 4 values are
+packed as 2-bit codes into one control byte. All control bytes come first, then
+all data bytes:
+    control     uint8[(n + 3) / 4]
+    data        1 to 4 bytes per value, little endian
+
+Decoding handles 4 values per control byte with one SSSE3 shuffle and a SIMD
+prefix sum, and falls back to a scalar loop on CPUs without SSSE3.
+*/
+
+
+/**
+ * @brief Number of padding bytes the decoder may read past the end of the data.
+ */
+const size_t STREAMVBYTE_PADDING = 16;
+
+
+/**
+ * @brief Append an increasing list of non-negative ints in StreamVByte encoding.
+ *
+ * @param values The values, in increasing order.
+ * @param num_values The number of values.
+ * @param output The bytes to append to.
+ */
+void streamvbyte_encode_deltas(const int* values, size_t num_values, std::vector<uint8_t>& output);
+
+
+/**
+ * @brief Decode consecutive values of a StreamVByte list.
+ *
+ * @param control The control byte of the first value to decode (the values to decode must start at a group of 4).
+ * @param data The data bytes of the first value to decode, advanced past the decoded values.
+ *             STREAMVBYTE_PADDING bytes must be readable past the end of the data.
+ * @param num_values The number of values to decode.
+ * @param previous The value before the first value to decode (0 at the start of the list).
+ * @param output The decoded values.
+ */
+void streamvbyte_decode_deltas(const uint8_t* control, const uint8_t*& data, size_t num_values,
+                                int previous, int* output);
+
+#endif
@@ -0,0 +1,213 @@
+#include "ZipArchive.h"
+#include "Inflater.h"
+
+#include <cstring>
+
+
+// record signatures
+static const uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+static const uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+static const uint32_t END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06054b50;
+static const uint32_t ZIP64_END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06064b50;
+static const uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+
+// fixed record sizes
+static const size_t LOCAL_HEADER_SIZE = 30;
+static const size_t CENTRAL_HEADER_SIZE = 46;
+static const size_t END_OF_CENTRAL_DIRECTORY_SIZE = 22;
+static const size_t ZIP64_LOCATOR_SIZE = 20;
+static const size_t ZIP64_END_OF_CENTRAL_DIRECTORY_SIZE = 56;
+
+// compression methods
+static const uint16_t METHOD_STORED = 0;
+static const uint16_t METHOD_DEFLATE = 8;
+
+static const uint16_t ZIP64_EXTRA_FIELD_ID = 0x0001;
+
+
+static inline uint16_t read_u16(const char* p) {
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read_u32(const char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t read_u64(const char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+
+ZipArchive::ZipArchive() {
+}
+
+
+bool ZipArchive::open(const std::string& archive_path) {
+    archive_entries.clear();
+    entry_ids.clear();
+    if (!mapped_file.open(archive_path)) {
+        return false;
+    }
+    if (!read_central_directory()) {
+        mapped_file.close();
+        archive_entries.clear();
+        entry_ids.clear();
+        return false;
+    }
+    return true;
+}
+
+
+bool ZipArchive::read_central_directory() {
+    const char* data = mapped_file.data();
+    size_t size = mapped_file.size();
+    if (size < END_OF_CENTRAL_DIRECTORY_SIZE) {
+        return false;
+    }
+
+    // the end of central directory record is at the end, followed by a comment of up to 64k
+    size_t eocd_offset = size - END_OF_CENTRAL_DIRECTORY_SIZE;
+    size_t search_limit = (size > END_OF_CENTRAL_DIRECTORY_SIZE + 0xFFFF) ? size - END_OF_CENTRAL_DIRECTORY_SIZE - 0xFFFF : 0;
+    while (read_u32(data + eocd_offset) != END_OF_CENTRAL_DIRECTORY_SIGNATURE) {
+        if (eocd_offset == search_limit) {
+            return false;
+        }
+        eocd_offset--;
+    }
+
+    uint64_t num_entries = read_u16(data + eocd_offset + 10);
+    uint64_t central_directory_offset = read_u32(data + eocd_offset + 16);
+
+    // zip64: the real values are in the zip64 end of central directory record
+    if (eocd_offset >= ZIP64_LOCATOR_SIZE 
+            && read_u32(data + eocd_offset - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR_SIGNATURE) {
+        uint64_t zip64_eocd_offset = read_u64(data + eocd_offset - ZIP64_LOCATOR_SIZE + 8);
+        if (zip64_eocd_offset + ZIP64_END_OF_CENTRAL_DIRECTORY_SIZE > size
+                || read_u32(data + zip64_eocd_offset) != ZIP64_END_OF_CENTRAL_DIRECTORY_SIGNATURE) {
+            return false;
+        }
+        num_entries = read_u64(data + zip64_eocd_offset + 32);
+        central_directory_offset = read_u64(data + zip64_eocd_offset + 48);
+    }
+
+    archive_entries.reserve(num_entries);
+    size_t offset = central_directory_offset;
+    for (uint64_t i = 0; i < num_entries; i++) {
+        if (offset + CENTRAL_HEADER_SIZE > size || read_u32(data + offset) != CENTRAL_HEADER_SIGNATURE) {
+            return false;
+        }
+        const char* header = data + offset;
+        Entry entry;
+        entry.compression_method = read_u16(header + 10);
+        entry.compressed_size = read_u32(header + 20);
+        entry.uncompressed_size = read_u32(header + 24);
+        uint16_t name_length = read_u16(header + 28);
+        uint16_t extra_length = read_u16(header + 30);
+        uint16_t comment_length = read_u16(header + 32);
+        entry.local_header_offset = read_u32(header + 42);
+        if (offset + CENTRAL_HEADER_SIZE + name_length + extra_length + comment_length > size) {
+            return false;
+        }
+        entry.name.assign(header + CENTRAL_HEADER_SIZE, name_length);
+
+        // zip64 extra field: 64-bit values for those saturated in the header, in this order
+        const char* extra = header + CENTRAL_HEADER_SIZE + name_length;
+        const char* extra_end = extra + extra_length;
+        while (extra + 4 <= extra_end) {
+            uint16_t field_id = read_u16(extra);
+            uint16_t field_size = read_u16(extra + 2);
+            const char* field = extra + 4;
+            const char* field_end = field + field_size;
+            if (field_end > extra_end) {
+                break;
+            }
+            if (field_id == ZIP64_EXTRA_FIELD_ID) {
+                if (entry.uncompressed_size == 0xFFFFFFFF && field + 8 <= field_end) {
+                    entry.uncompressed_size = read_u64(field);
+                    field += 8;
+                }
+                if (entry.compressed_size == 0xFFFFFFFF && field + 8 <= field_end) {
+                    entry.compressed_size = read_u64(field);
+                    field += 8;
+                }
+                if (entry.local_header_offset == 0xFFFFFFFF && field + 8 <= field_end) {
+                    entry.local_header_offset = read_u64(field);
+                    field += 8;
+                }
+            }
+            extra = field_end;
+        }
+
+        entry_ids[entry.name] = archive_entries.size();
+        archive_entries.push_back(std::move(entry));
+        offset += CENTRAL_HEADER_SIZE + name_length + extra_length + comment_length;
+    }
+
+    return true;
+}
+
+
+long ZipArchive::find(const std::string& name) const {
+    auto it = entry_ids.find(name);
+    if (it == entry_ids.end()) {
+        return -1;
+    }
+    return it->second;
+}
+
+
+const char* ZipArchive::raw_data(size_t entry_id, size_t& size) const {
+    const Entry& entry = archive_entries[entry_id];
+    const char* data = mapped_file.data();
+    size_t offset = entry.local_header_offset;
+    if (offset + LOCAL_HEADER_SIZE > mapped_file.size() || read_u32(data + offset) != LOCAL_HEADER_SIGNATURE) {
+        return nullptr;
+    }
+
+    // the local header may have a different extra field than the central directory
+    uint16_t name_length = read_u16(data + offset + 26);
+    uint16_t extra_length = read_u16(data + offset + 28);
+    size_t data_offset = offset + LOCAL_HEADER_SIZE + name_length + extra_length;
+    if (data_offset + entry.compressed_size > mapped_file.size()) {
+        return nullptr;
+    }
+    size = entry.compressed_size;
+    return data + data_offset;
+}
+
+
+const char* ZipArchive::read(size_t entry_id, size_t& size, std::string& buffer) const {
+    size_t raw_size;
+    const char* raw = raw_data(entry_id, raw_size);
+    if (raw == nullptr) {
+        return nullptr;
+    }
+
+    const Entry& entry = archive_entries[entry_id];
+    if (entry.compression_method == METHOD_STORED) {
+        size = raw_size;
+        return raw;
+    } else if (entry.compression_method == METHOD_DEFLATE) {
+        if (!inflate_buffer(raw, raw_size, Inflater::RAW_DEFLATE, buffer, entry.uncompressed_size)) {
+            return nullptr;
+        }
+        size = buffer.size();
+        return buffer.data();
+    }
+    return nullptr;
+}
+
+
+bool ZipArchive::is_zip(const char* data, size_t size) {
+    if (size < 4) {
+        return false;
+    }
+    return read_u32(data) == LOCAL_HEADER_SIGNATURE || read_u32(data) == END_OF_CENTRAL_DIRECTORY_SIGNATURE;
+}
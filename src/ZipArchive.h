@@ -0,0 +1,90 @@
+#ifndef ZIPARCHIVE_H
+#define ZIPARCHIVE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "MappedFile.h"
+
+
+/**
+ * @brief Read-only access to the members of a zip archive (e.g. a sourmash zip collection).
+ * 
+ * The archive is memory mapped once and the central directory is parsed once
+ * when the archive is opened. Members are read directly from the mapping, so
+ * several threads can read (and inflate) different members at the same time.
+ * 
+ * Supports stored and deflated members, and zip64 archives.
+ */
+class ZipArchive {
+    public:
+        struct Entry {
+            std::string name;
+            uint16_t compression_method;
+            uint64_t compressed_size;
+            uint64_t uncompressed_size;
+            uint64_t local_header_offset;
+        };
+
+        ZipArchive();
+
+        /**
+         * @brief Open a zip archive and read its central directory.
+         * 
+         * @param archive_path The path to the zip file.
+         * @return true If the archive was opened.
+         * @return false If the file could not be mapped or is not a valid zip archive.
+         */
+        bool open(const std::string& archive_path);
+
+        const std::vector<Entry>& entries() const {
+            return this->archive_entries;
+        }
+
+        /**
+         * @brief Find a member by name.
+         * 
+         * @param name The name of the member inside the archive.
+         * @return long The id of the member, -1 if there is no such member.
+         */
+        long find(const std::string& name) const;
+
+        /**
+         * @brief Get the raw (possibly compressed) bytes of a member, pointing into the mapping.
+         * 
+         * @param entry_id The id of the member.
+         * @param size The number of raw bytes.
+         * @return const char* The raw bytes, nullptr if the local header is broken.
+         */
+        const char* raw_data(size_t entry_id, size_t& size) const;
+
+        /**
+         * @brief Get the uncompressed contents of a member.
+         * 
+         * Stored members are returned straight from the mapping, deflated members 
+         * are inflated into the buffer.
+         * 
+         * @param entry_id The id of the member.
+         * @param size The size of the contents.
+         * @param buffer The string used to hold inflated contents.
+         * @return const char* The contents, nullptr if the member is broken or uses 
+         *                     an unsupported compression method.
+         */
+        const char* read(size_t entry_id, size_t& size, std::string& buffer) const;
+
+        /**
+         * @brief Check if a buffer starts with the zip magic bytes.
+         */
+        static bool is_zip(const char* data, size_t size);
+
+    private:
+        MappedFile mapped_file;
+        std::vector<Entry> archive_entries;
+        std::unordered_map<std::string, size_t> entry_ids;
+
+        bool read_central_directory();
+};
+
+#endif
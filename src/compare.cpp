@@ -11,7 +11,7 @@ write the results to a file.
 #include "argparse.hpp"
 #include "json.hpp"
 #include "utils.h"
-#include "MultiSketchIndex.h"
+#include "FrozenSketchIndex.h"
 
 using namespace std;
 using json = nlohmann::json;
@@ -23,7 +23,15 @@ struct Arguments {
     double containment_threshold;
     int number_of_threads;
     int num_hashtables;
+    bool compress_postings;
+    string key_layout;
+    string index_path;
     int num_passes;
+    int ksize;
+    int seed;
+    int scaled;
+    bool largest_first;
+    int io_threads;
 };
 
 
@@ -36,7 +44,14 @@ void do_compare(Arguments& args) {
     vector<string> all_sketch_paths;
     vector<Sketch> all_sketches;
     vector<int> empty_sketch_ids;
-    MultiSketchIndex all_sketch_index(args.num_hashtables);
+    FrozenSketchIndex all_sketch_index(args.compress_postings ? POSTINGS_STREAMVBYTE : POSTINGS_RAW, 
+                                    key_layout_from_name(args.key_layout));
+    SketchLoadOptions load_options;
+    load_options.ksize = args.ksize;
+    load_options.seed = args.seed;
+    load_options.scaled = args.scaled;
+    load_options.largest_first = args.largest_first;
+    load_options.io_threads = args.io_threads;
 
     // Read the sketches
     auto read_start = chrono::high_resolution_clock::now();
@@ -45,20 +60,34 @@ void do_compare(Arguments& args) {
     read_sketches(all_sketch_paths, 
                     all_sketches, 
                     empty_sketch_ids, 
-                    args.number_of_threads);
+                    args.number_of_threads,
+                    load_options);
     auto read_end = chrono::high_resolution_clock::now();
     auto read_duration = chrono::duration_cast<chrono::seconds>(read_end - read_start);
     cout << "Reading completed in " << read_duration.count() << " seconds." << endl;
 
-    // Compute the index from the sketches
+    // Compute the index from the sketches, or load a saved one
     auto start = chrono::high_resolution_clock::now();
-    cout << "Building an index on all the kmers... (will take some time)" << endl;
-    compute_index_from_sketches(all_sketches, 
-                                all_sketch_index, 
-                                args.number_of_threads);
+    bool index_loaded = false;
+    if (args.index_path.empty()) {
+        cout << "Building an index on all the kmers... (will take some time)" << endl;
+        compute_index_from_sketches(all_sketches, 
+                                    all_sketch_index, 
+                                    args.number_of_threads);
+    } else {
+        index_loaded = load_or_compute_index(all_sketches, all_sketch_index, args.index_path, args.number_of_threads);
+    }
     auto end = chrono::high_resolution_clock::now();
     auto duration_in_seconds = chrono::duration_cast<chrono::seconds>(end - start);
-    cout << "Index building completed in " << duration_in_seconds.count() << " seconds." << endl;
+    cout << (index_loaded ? "Index loading" : "Index building") << " completed in " << duration_in_seconds.count() << " seconds." << endl;
+    cout << "Number of distinct kmers: " << all_sketch_index.size() << endl;
+    cout << "Index size in memory: " << all_sketch_index.memory_usage() / (1024.0 * 1024.0) << " MB" << endl;
+    cout << "Index keys: " << KEY_LAYOUT_NAMES[all_sketch_index.keys_layout()] << endl;
+    // a query hash absent from the references may still hit a slot, and count its references
+    if (all_sketch_index.keys_layout() == KEYS_MPHF) {
+        cerr << "Warning: the index has mphf keys, so the containment values are approximate "
+                << "(an absent hash matches with probability 2^-16)" << endl;
+    }
 
     // Compute all v all containment values
     cout << "Computing all v all containment values..." << endl;
@@ -150,17 +179,65 @@ void parse_args(int argc, char** argv, Arguments &arguments) {
         .store_into(arguments.number_of_threads);
     
     parser.add_argument("-n", "--num-hashtables")
-        .help("The number of hash tables to use")
+        .help("Deprecated, has no effect: the index is no longer split into hash tables")
         .scan<'i', int>()
         .default_value(4096)
         .store_into(arguments.num_hashtables);
 
+    parser.add_argument("--compress-postings")
+        .help("Store the posting lists of the index compressed (smaller index, slightly slower lookups)")
+        .flag()
+        .store_into(arguments.compress_postings);
+
+    parser.add_argument("--keys")
+        .help("How the index stores the distinct hashes: sorted (32-bit keys when dense enough), "
+                "directory (fastest lookups, 32-bit keys when they fit), elias-fano (compact) or mphf "
+                "(smallest, approximate counts: absent hashes match with probability 2^-16)")
+        .choices("sorted", "directory", "elias-fano", "mphf")
+        .default_value(string("sorted"))
+        .store_into(arguments.key_layout);
+
+    parser.add_argument("--index")
+        .help("Load the index from this file, or build it and save it there if the file does not exist "
+                "(--compress-postings and --keys only apply when building)")
+        .default_value(string(""))
+        .store_into(arguments.index_path);
+
     parser.add_argument("-p", "--num-passes")
         .help("The number of passes to use")
         .scan<'i', int>()
         .default_value(1)
         .store_into(arguments.num_passes);
     
+    parser.add_argument("-k", "--ksize")
+        .help("Only use signatures with this ksize (0: use all signatures)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.ksize);
+
+    parser.add_argument("-s", "--seed")
+        .help("Only use signatures with this seed (-1: any seed)")
+        .scan<'i', int>()
+        .default_value(-1)
+        .store_into(arguments.seed);
+
+    parser.add_argument("--scaled")
+        .help("Downsample the sketches to this scaled while reading them (0: keep all hashes)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.scaled);
+
+    parser.add_argument("--largest-first")
+        .help("Read the largest sketch files first, to balance the threads when file sizes vary a lot")
+        .flag()
+        .store_into(arguments.largest_first);
+
+    parser.add_argument("--io-threads")
+        .help("The number of extra threads reading sketch files ahead of the parsing threads (0: parsing threads read)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.io_threads);
+
     try {
         parser.parse_args(argc, argv);
     } catch (const std::runtime_error &err) {
@@ -169,6 +246,10 @@ void parse_args(int argc, char** argv, Arguments &arguments) {
         exit(1);
     }
 
+    if (parser.is_used("--num-hashtables")) {
+        std::cerr << "Warning: --num-hashtables is deprecated and has no effect" << std::endl;
+    }
+
 }
 
 
@@ -181,8 +262,15 @@ void show_args(Arguments &args) {
     cout << "*   Output filename: " << args.output_filename << endl;
     cout << "*   Containment threshold: " << args.containment_threshold << endl;
     cout << "*   Number of threads: " << args.number_of_threads << endl;
-    cout << "*   Number of hash tables: " << args.num_hashtables << endl;
+    cout << "*   Compressed posting lists: " << (args.compress_postings ? "yes" : "no") << endl;
+    cout << "*   Index keys: " << args.key_layout << endl;
+    cout << "*   Saved index: " << (args.index_path.empty() ? "none" : args.index_path) << endl;
     cout << "*   Number of passes: " << args.num_passes << endl;
+    cout << "*   ksize: " << args.ksize << endl;
+    cout << "*   Seed: " << args.seed << endl;
+    cout << "*   Scaled: " << args.scaled << endl;
+    cout << "*   Largest files first: " << (args.largest_first ? "yes" : "no") << endl;
+    cout << "*   Number of I/O threads: " << args.io_threads << endl;
     cout << "*" << endl;
     cout << "**************************************" << endl;
 }
@@ -1,7 +1,7 @@
 #include "argparse.hpp"
 #include "json.hpp"
 #include "utils.h"
-#include "MultiSketchIndex.h"
+#include "FrozenSketchIndex.h"
 
 #include <iostream>
 #include <fstream>
@@ -36,6 +36,15 @@ struct Arguments {
     int number_of_threads;
     int threshold_bp;
     int num_hashtables;
+    bool compress_postings;
+    string key_layout;
+    string index_path;
+    int ksize;
+    int seed;
+    int scaled;
+    bool largest_first;
+    int io_threads;
+    bool lazy_metadata;
 };
 
 
@@ -50,14 +59,24 @@ void do_gather(Arguments& args) {
     vector<string> ref_sketch_paths;
     vector<Sketch> ref_sketches;
     vector<int> empty_sketch_ids;
-    MultiSketchIndex ref_index(args.num_hashtables);
+    FrozenSketchIndex ref_index(args.compress_postings ? POSTINGS_STREAMVBYTE : POSTINGS_RAW, 
+                                    key_layout_from_name(args.key_layout));
+    SketchLoadOptions load_options;
+    load_options.ksize = args.ksize;
+    load_options.seed = args.seed;
+    load_options.scaled = args.scaled;
+    load_options.largest_first = args.largest_first;
+    load_options.io_threads = args.io_threads;
+    load_options.lazy_metadata = args.lazy_metadata;
 
     // Read the query sketch and the reference sketches
     auto read_start = chrono::high_resolution_clock::now();
     cout << "Reading all reference sketches and the query sketch using " << args.number_of_threads << " threads" << endl;
-    query_sketch = read_min_hashes(args.query_path);
+    SketchLoadOptions query_load_options = load_options;
+    query_load_options.lazy_metadata = false;
+    query_sketch = read_min_hashes(args.query_path, query_load_options);
     get_sketch_paths(args.ref_filelist, ref_sketch_paths);
-    read_sketches(ref_sketch_paths, ref_sketches, empty_sketch_ids, args.number_of_threads);
+    read_sketches(ref_sketch_paths, ref_sketches, empty_sketch_ids, args.number_of_threads, load_options);
     
     // read complete, show time taken
     auto read_end = chrono::high_resolution_clock::now();
@@ -75,49 +94,58 @@ void do_gather(Arguments& args) {
     cout << "Number of kmers in query: " << query_sketch.size() << endl;
     cout << "Number of kmers in all the references: " << num_total_hashes_in_ref << endl;
 
-    // Compute the index from the reference sketches
+    // Compute the index from the reference sketches, or load a saved one
     auto start = chrono::high_resolution_clock::now();
-    cout << "Building an index on all the reference kmers... (will take some time)" << endl;
-    compute_index_from_sketches(ref_sketches, ref_index, args.number_of_threads);
+    bool index_loaded = false;
+    if (args.index_path.empty()) {
+        cout << "Building an index on all the reference kmers... (will take some time)" << endl;
+        compute_index_from_sketches(ref_sketches, ref_index, args.number_of_threads);
+    } else {
+        index_loaded = load_or_compute_index(ref_sketches, ref_index, args.index_path, args.number_of_threads);
+        // a false hit would count a reference which does not have the hash, and could change the matches
+        if (ref_index.keys_layout() == KEYS_MPHF) {
+            cerr << "The index at " << args.index_path << " has mphf keys, which gather cannot use "
+                    << "(absent hashes may match): use an index with other keys" << endl;
+            exit(1);
+        }
+    }
     auto end = chrono::high_resolution_clock::now();
     auto duration_in_seconds = chrono::duration_cast<chrono::seconds>(end - start);
-    cout << "Index building completed in " << duration_in_seconds.count() << " seconds." << endl;
+    cout << (index_loaded ? "Index loading" : "Index building") << " completed in " << duration_in_seconds.count() << " seconds." << endl;
 
     // show num of hashes in ref
     cout << "Number of distinct kmers in the references: " << ref_index.size() << endl;
+    cout << "Index size in memory: " << ref_index.memory_usage() / (1024.0 * 1024.0) << " MB" << endl;
+    cout << "Index keys: " << KEY_LAYOUT_NAMES[ref_index.keys_layout()] << endl;
 
     // start gather
     cout << "Now searching the query kmers against the references..." << endl;
 
-    vector<hash_t> query_hashes_present_in_ref;
-    for (hash_t hash_value : query_sketch.hashes) {
-        if ( ref_index.hash_exists(hash_value) ) {
-            query_hashes_present_in_ref.push_back(hash_value);
-        }
-    }
-    cout << "Number of kmers in query present in the references: " << query_hashes_present_in_ref.size() << endl;
-
     size_t* num_intersection_values = new size_t[ref_sketches.size()];
     size_t* num_intersection_values_orig = new size_t[ref_sketches.size()];
     for (size_t i = 0; i < ref_sketches.size(); i++) {
         num_intersection_values[i] = 0;
         num_intersection_values_orig[i] = 0;
     }
-    for (hash_t hash_value : query_hashes_present_in_ref) {
-        vector<int> matching_ref_ids = ref_index.get_sketch_indices(hash_value);
-        for (int ref_id : matching_ref_ids) {
+    size_t num_query_hashes_present_in_ref = 0;
+    ref_index.lookup_batch(query_sketch.data(), query_sketch.size(), [&](size_t, PostingView matching_ref_ids) {
+        if (matching_ref_ids.empty()) {
+            return;
+        }
+        num_query_hashes_present_in_ref++;
+        matching_ref_ids.for_each([&](int ref_id) {
             num_intersection_values[ref_id]++;
             num_intersection_values_orig[ref_id]++;
-        }
-    }
+        });
+    });
+    cout << "Number of kmers in query present in the references: " << num_query_hashes_present_in_ref << endl;
 
     // build an unordered map of the hashes in the query sketch
     unordered_map<hash_t, bool> query_hash_map;
-    for (hash_t hash_value : query_sketch.hashes) {
+    for (hash_t hash_value : query_sketch) {
         query_hash_map[hash_value] = true;
     }
 
-    int num_iterations = 0;
     vector<tuple<
                 int, size_t, size_t, double, double, double, double
                     >> results;
@@ -141,7 +169,7 @@ void do_gather(Arguments& args) {
         
 
         // if overlap is below threshold then stop
-        if (max_intersection_value < args.threshold_bp) {
+        if (max_intersection_value < (size_t)args.threshold_bp) {
             cout << "Matched " << max_intersection_ref_id+1 << "\t-th genome, overlap now: " << max_intersection_value << endl;
             cout << "Num overlap is less than the threshold of " << args.threshold_bp << " bp. Stopping gather..." << endl;
             break;
@@ -164,21 +192,22 @@ void do_gather(Arguments& args) {
                         f_orig_query,
                         f_match));
 
-        // remove the ref sketch with the maximum number of intersections
-        for (hash_t hash_value : ref_sketches[max_intersection_ref_id].hashes) {
-            // remove the hash value from the index
-            vector<int> removed_ids = ref_index.remove_hash(hash_value);
-
-            // removed ids are the ids of the references in which this hash appeared
-            // if this hash is in the query, then decrememt the intersection values appropriately
-            // and finally, remove the hash from the query hash map
+        // remove the ref sketch with the maximum number of intersections:
+        // for each of its hashes still in the query, decrememt the intersection values of 
+        // the references in which this hash appears, and remove the hash from the query hash map.
+        // the index itself is left as is, a hash no longer in the query is never counted again
+        vector<hash_t> hashes_to_remove;
+        for (hash_t hash_value : ref_sketches[max_intersection_ref_id]) {
             if (query_hash_map.find(hash_value) != query_hash_map.end()) {
-                for (int ref_id : removed_ids) {
-                    num_intersection_values[ref_id]--;
-                }
+                hashes_to_remove.push_back(hash_value);
                 query_hash_map.erase(hash_value);
             }
         }
+        ref_index.lookup_batch(hashes_to_remove.data(), hashes_to_remove.size(), [&](size_t, PostingView ref_ids) {
+            ref_ids.for_each([&](int ref_id) {
+                num_intersection_values[ref_id]--;
+            });
+        });
 
     }
 
@@ -197,6 +226,7 @@ void do_gather(Arguments& args) {
         double f_orig_query = get<5>(result);
         double f_match = get<6>(result);
 
+        load_sketch_metadata(ref_sketches[sketch_index], ref_sketch_paths);
         string file_path = ref_sketches[sketch_index].file_path;
         string name = ref_sketches[sketch_index].name;
         string md5 = ref_sketches[sketch_index].md5;
@@ -250,11 +280,64 @@ void parse_args(int argc, char** argv, Arguments &arguments) {
         .store_into(arguments.threshold_bp);
 
     parser.add_argument("-n", "--num-hashtables")
-        .help("The number of hash tables to use")
+        .help("Deprecated, has no effect: the index is no longer split into hash tables")
         .scan<'i', int>()
         .default_value(4096)
         .store_into(arguments.num_hashtables);
 
+    parser.add_argument("--compress-postings")
+        .help("Store the posting lists of the index compressed (smaller index, slightly slower lookups)")
+        .flag()
+        .store_into(arguments.compress_postings);
+
+    parser.add_argument("--keys")
+        .help("How the index stores the distinct hashes: sorted (32-bit keys when dense enough), "
+                "directory (fastest lookups, 32-bit keys when they fit) or elias-fano (compact). "
+                "mphf is not available: gather needs exact lookups")
+        .choices("sorted", "directory", "elias-fano", "mphf")
+        .default_value(string("sorted"))
+        .store_into(arguments.key_layout);
+
+    parser.add_argument("--index")
+        .help("Load the index from this file, or build it and save it there if the file does not exist "
+                "(--compress-postings and --keys only apply when building)")
+        .default_value(string(""))
+        .store_into(arguments.index_path);
+
+    parser.add_argument("-k", "--ksize")
+        .help("Only use signatures with this ksize (0: use all signatures)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.ksize);
+
+    parser.add_argument("-s", "--seed")
+        .help("Only use signatures with this seed (-1: any seed)")
+        .scan<'i', int>()
+        .default_value(-1)
+        .store_into(arguments.seed);
+
+    parser.add_argument("--scaled")
+        .help("Downsample the sketches to this scaled while reading them (0: keep all hashes)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.scaled);
+
+    parser.add_argument("--largest-first")
+        .help("Read the largest sketch files first, to balance the threads when file sizes vary a lot")
+        .flag()
+        .store_into(arguments.largest_first);
+
+    parser.add_argument("--io-threads")
+        .help("The number of extra threads reading sketch files ahead of the parsing threads (0: parsing threads read)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.io_threads);
+
+    parser.add_argument("--lazy-metadata")
+        .help("Do not keep names and md5s of the references in memory, read them again for the matches only")
+        .flag()
+        .store_into(arguments.lazy_metadata);
+
     try {
         parser.parse_args(argc, argv);
     } catch (const std::runtime_error &err) {
@@ -262,6 +345,16 @@ void parse_args(int argc, char** argv, Arguments &arguments) {
         std::cout << parser;
         exit(1);
     }
+
+    if (arguments.key_layout == "mphf") {
+        std::cerr << "--keys mphf is not available in gather: an absent hash may match, "
+                    << "and one false match can change the references gather picks" << std::endl;
+        exit(1);
+    }
+
+    if (parser.is_used("--num-hashtables")) {
+        std::cerr << "Warning: --num-hashtables is deprecated and has no effect" << std::endl;
+    }
 }
 
 
@@ -274,7 +367,15 @@ void show_args(Arguments &args) {
     cout << "*   Output filename: " << args.output_filename << endl;
     cout << "*   Number of threads: " << args.number_of_threads << endl;
     cout << "*   Threshold in base pairs: " << args.threshold_bp << endl;
-    cout << "*   Number of hash tables in the index: " << args.num_hashtables << endl;
+    cout << "*   Compressed posting lists: " << (args.compress_postings ? "yes" : "no") << endl;
+    cout << "*   Index keys: " << args.key_layout << endl;
+    cout << "*   Saved index: " << (args.index_path.empty() ? "none" : args.index_path) << endl;
+    cout << "*   ksize: " << args.ksize << endl;
+    cout << "*   Seed: " << args.seed << endl;
+    cout << "*   Scaled: " << args.scaled << endl;
+    cout << "*   Largest files first: " << (args.largest_first ? "yes" : "no") << endl;
+    cout << "*   Number of I/O threads: " << args.io_threads << endl;
+    cout << "*   Lazy metadata: " << (args.lazy_metadata ? "yes" : "no") << endl;
     cout << "*" << endl;
     cout << "**************************************" << endl;
 } 
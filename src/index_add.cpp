@@ -0,0 +1,190 @@
+/*
+Load an index saved by gather, prefetch or compare (--index),
+read new sketches present in a filelist (or zip collection),
+and write the index of the old and the new sketches.
+The references of the new index are the old references followed by
+the new sketches, in this order.
+*/
+
+#include <iostream>
+#include <vector>
+#include <cstdio>
+
+#include "argparse.hpp"
+#include "utils.h"
+#include "FrozenSketchIndex.h"
+
+using namespace std;
+
+
+struct Arguments {
+    string index_path;
+    string filelist;
+    string output_filename;
+    int number_of_threads;
+    int ksize;
+    int seed;
+    int scaled;
+    bool largest_first;
+    int io_threads;
+};
+
+
+typedef Arguments Arguments;
+
+
+
+void do_index_add(Arguments& args) {
+    // data structures
+    vector<string> sketch_paths;
+    vector<Sketch> sketches;
+    vector<int> empty_sketch_ids;
+    FrozenSketchIndex index;
+    SketchLoadOptions load_options;
+    load_options.ksize = args.ksize;
+    load_options.seed = args.seed;
+    load_options.scaled = args.scaled;
+    load_options.largest_first = args.largest_first;
+    load_options.io_threads = args.io_threads;
+
+    // Load the saved index
+    cout << "Loading the index from " << args.index_path << endl;
+    if (!index.load(args.index_path)) {
+        cerr << "Not a saved index: " << args.index_path << endl;
+        exit(1);
+    }
+    cout << "The index has " << index.num_sketches() << " sketches and " << index.size() << " distinct kmers." << endl;
+
+    // Read the new sketches
+    auto read_start = chrono::high_resolution_clock::now();
+    cout << "Reading the new sketches using " << args.number_of_threads << " threads" << endl;
+    get_sketch_paths(args.filelist, sketch_paths);
+    read_sketches(sketch_paths, sketches, empty_sketch_ids, args.number_of_threads, load_options);
+    auto read_end = chrono::high_resolution_clock::now();
+    auto read_duration = chrono::duration_cast<chrono::seconds>(read_end - read_start);
+    cout << "Read " << sketches.size() << " sketches in " << read_duration.count() << " seconds." << endl;
+    show_empty_sketches(empty_sketch_ids);
+
+    // Merge the new sketches into the index
+    auto start = chrono::high_resolution_clock::now();
+    cout << "Adding the new sketches to the index..." << endl;
+    FrozenSketchIndex updated_index(index.posting_codec(), index.keys_layout());
+    if (!updated_index.build_appended(index, sketches, args.number_of_threads)) {
+        exit(1);
+    }
+    auto end = chrono::high_resolution_clock::now();
+    auto duration_in_seconds = chrono::duration_cast<chrono::seconds>(end - start);
+    cout << "Index updated in " << duration_in_seconds.count() << " seconds." << endl;
+    cout << "The updated index has " << updated_index.num_sketches() << " sketches and "
+            << updated_index.size() << " distinct kmers." << endl;
+
+    // Write the index next to the output, then move it in place (the output may be the mapped input)
+    cout << "Writing the index to " << args.output_filename << endl;
+    string temporary_filename = args.output_filename + ".tmp";
+    if (!updated_index.save(temporary_filename)) {
+        exit(1);
+    }
+    if (rename(temporary_filename.c_str(), args.output_filename.c_str()) != 0) {
+        cerr << "Could not move " << temporary_filename << " to " << args.output_filename << endl;
+        exit(1);
+    }
+    cout << "Index written to " << args.output_filename << endl;
+
+}
+
+
+
+void parse_args(int argc, char** argv, Arguments &arguments) {
+
+    argparse::ArgumentParser parser("index-add: add new sketches to a saved index");
+
+    parser.add_argument("index_path")
+        .help("The path to the saved index (written with --index by gather, prefetch or compare)")
+        .required()
+        .store_into(arguments.index_path);
+
+    parser.add_argument("filelist")
+        .help("The path to the file containing the paths to the new sketches")
+        .required()
+        .store_into(arguments.filelist);
+
+    parser.add_argument("output_filename")
+        .help("The path to the index to write (may be the saved index)")
+        .required()
+        .store_into(arguments.output_filename);
+
+    parser.add_argument("-t", "--threads")
+        .help("The number of threads to use")
+        .scan<'i', int>()
+        .default_value(1)
+        .store_into(arguments.number_of_threads);
+
+    parser.add_argument("-k", "--ksize")
+        .help("Only use signatures with this ksize (0: use all signatures)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.ksize);
+
+    parser.add_argument("-s", "--seed")
+        .help("Only use signatures with this seed (-1: any seed)")
+        .scan<'i', int>()
+        .default_value(-1)
+        .store_into(arguments.seed);
+
+    parser.add_argument("--scaled")
+        .help("Downsample the sketches to this scaled while reading them (0: keep all hashes)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.scaled);
+
+    parser.add_argument("--largest-first")
+        .help("Read the largest sketch files first, to balance the threads when file sizes vary a lot")
+        .flag()
+        .store_into(arguments.largest_first);
+
+    parser.add_argument("--io-threads")
+        .help("The number of extra threads reading sketch files ahead of the parsing threads (0: parsing threads read)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.io_threads);
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::runtime_error &err) {
+        std::cout << err.what() << std::endl;
+        std::cout << parser;
+        exit(1);
+    }
+
+}
+
+
+
+void show_args(Arguments &args) {
+    cout << "**************************************" << endl;
+    cout << "*" << endl;
+    cout << "*   Index path: " << args.index_path << endl;
+    cout << "*   Filelist: " << args.filelist << endl;
+    cout << "*   Output filename: " << args.output_filename << endl;
+    cout << "*   Number of threads: " << args.number_of_threads << endl;
+    cout << "*   ksize: " << args.ksize << endl;
+    cout << "*   Seed: " << args.seed << endl;
+    cout << "*   Scaled: " << args.scaled << endl;
+    cout << "*   Largest files first: " << (args.largest_first ? "yes" : "no") << endl;
+    cout << "*   Number of I/O threads: " << args.io_threads << endl;
+    cout << "*" << endl;
+    cout << "**************************************" << endl;
+}
+
+
+
+int main( int argc, char** argv ) {
+
+    Arguments arguments;
+    parse_args(argc, argv, arguments);
+    show_args(arguments);
+    do_index_add(arguments);
+
+    return 0;
+
+}
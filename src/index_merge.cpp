@@ -0,0 +1,116 @@
+/*
+Merge indexes saved by gather, prefetch, compare (--index) or index-add
+into a single saved index.
+The references of the merged index are those of the first index,
+followed by those of the second one, and so on.
+*/
+
+#include <iostream>
+#include <vector>
+#include <cstdio>
+
+#include "argparse.hpp"
+#include "utils.h"
+#include "FrozenSketchIndex.h"
+
+using namespace std;
+
+
+struct Arguments {
+    string output_filename;
+    vector<string> index_paths;
+    bool compress_postings;
+};
+
+
+typedef Arguments Arguments;
+
+
+
+void do_index_merge(Arguments& args) {
+    // Merge the indexes, into a file next to the output (the output may be one of the mapped inputs)
+    auto start = chrono::high_resolution_clock::now();
+    cout << "Merging " << args.index_paths.size() << " indexes..." << endl;
+    string temporary_filename = args.output_filename + ".tmp";
+    if (!FrozenSketchIndex::merge_saved(args.index_paths, temporary_filename,
+                                        args.compress_postings ? POSTINGS_STREAMVBYTE : POSTINGS_RAW)) {
+        remove(temporary_filename.c_str());
+        exit(1);
+    }
+    if (rename(temporary_filename.c_str(), args.output_filename.c_str()) != 0) {
+        cerr << "Could not move " << temporary_filename << " to " << args.output_filename << endl;
+        exit(1);
+    }
+    auto end = chrono::high_resolution_clock::now();
+    auto duration_in_seconds = chrono::duration_cast<chrono::seconds>(end - start);
+    cout << "Indexes merged in " << duration_in_seconds.count() << " seconds." << endl;
+
+    // Show what the merged index holds
+    FrozenSketchIndex merged_index;
+    if (!merged_index.load(args.output_filename)) {
+        cerr << "Could not load the merged index: " << args.output_filename << endl;
+        exit(1);
+    }
+    cout << "The merged index has " << merged_index.num_sketches() << " sketches and "
+            << merged_index.size() << " distinct kmers." << endl;
+    cout << "Index written to " << args.output_filename << endl;
+
+}
+
+
+
+void parse_args(int argc, char** argv, Arguments &arguments) {
+
+    argparse::ArgumentParser parser("index-merge: merge saved indexes into one");
+
+    parser.add_argument("output_filename")
+        .help("The path to the merged index to write")
+        .required()
+        .store_into(arguments.output_filename);
+
+    parser.add_argument("index_paths")
+        .help("The paths to the saved indexes to merge, in the order of their references")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .store_into(arguments.index_paths);
+
+    parser.add_argument("--compress-postings")
+        .help("Store the posting lists of the merged index compressed (smaller index, slightly slower lookups)")
+        .flag()
+        .store_into(arguments.compress_postings);
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::runtime_error &err) {
+        std::cout << err.what() << std::endl;
+        std::cout << parser;
+        exit(1);
+    }
+
+}
+
+
+
+void show_args(Arguments &args) {
+    cout << "**************************************" << endl;
+    cout << "*" << endl;
+    cout << "*   Output filename: " << args.output_filename << endl;
+    for (const string& index_path : args.index_paths) {
+        cout << "*   Index path: " << index_path << endl;
+    }
+    cout << "*   Compressed posting lists: " << (args.compress_postings ? "yes" : "no") << endl;
+    cout << "*" << endl;
+    cout << "**************************************" << endl;
+}
+
+
+
+int main( int argc, char** argv ) {
+
+    Arguments arguments;
+    parse_args(argc, argv, arguments);
+    show_args(arguments);
+    do_index_merge(arguments);
+
+    return 0;
+
+}
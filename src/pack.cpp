@@ -0,0 +1,153 @@
+/*
+Load sketches present in a filelist (or zip collection),
+and write them to a single packed sketch store,
+which all the tools can read in place of the filelist.
+*/
+
+#include <iostream>
+#include <vector>
+
+#include "argparse.hpp"
+#include "utils.h"
+#include "SketchStore.h"
+
+using namespace std;
+
+
+struct Arguments {
+    string filelist;
+    string output_filename;
+    int number_of_threads;
+    int ksize;
+    int seed;
+    int scaled;
+    bool largest_first;
+    int io_threads;
+};
+
+
+typedef Arguments Arguments;
+
+
+
+void do_pack(Arguments& args) {
+    // data structures
+    vector<string> sketch_paths;
+    vector<Sketch> sketches;
+    vector<int> empty_sketch_ids;
+    SketchLoadOptions load_options;
+    load_options.ksize = args.ksize;
+    load_options.seed = args.seed;
+    load_options.scaled = args.scaled;
+    load_options.largest_first = args.largest_first;
+    load_options.io_threads = args.io_threads;
+
+    // Read the sketches
+    auto read_start = chrono::high_resolution_clock::now();
+    cout << "Reading all sketches using " << args.number_of_threads << " threads" << endl;
+    get_sketch_paths(args.filelist, sketch_paths);
+    read_sketches(sketch_paths, sketches, empty_sketch_ids, args.number_of_threads, load_options);
+    auto read_end = chrono::high_resolution_clock::now();
+    auto read_duration = chrono::duration_cast<chrono::seconds>(read_end - read_start);
+    cout << "Read " << sketches.size() << " sketches in " << read_duration.count() << " seconds." << endl;
+    show_empty_sketches(empty_sketch_ids);
+
+    // Write the store
+    cout << "Writing the sketch store to " << args.output_filename << endl;
+    if (!write_sketch_store(args.output_filename, sketches)) {
+        exit(1);
+    }
+    cout << "Sketch store written to " << args.output_filename << endl;
+
+}
+
+
+
+void parse_args(int argc, char** argv, Arguments &arguments) {
+
+    argparse::ArgumentParser parser("pack: write sketches to a packed sketch store");
+
+    parser.add_argument("filelist")
+        .help("The path to the file containing the paths to the sketches")
+        .required()
+        .store_into(arguments.filelist);
+
+    parser.add_argument("output_filename")
+        .help("The path to the packed sketch store to write")
+        .required()
+        .store_into(arguments.output_filename);
+
+    parser.add_argument("-t", "--threads")
+        .help("The number of threads to use")
+        .scan<'i', int>()
+        .default_value(1)
+        .store_into(arguments.number_of_threads);
+
+    parser.add_argument("-k", "--ksize")
+        .help("Only use signatures with this ksize (0: use all signatures)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.ksize);
+
+    parser.add_argument("-s", "--seed")
+        .help("Only use signatures with this seed (-1: any seed)")
+        .scan<'i', int>()
+        .default_value(-1)
+        .store_into(arguments.seed);
+
+    parser.add_argument("--scaled")
+        .help("Downsample the sketches to this scaled while reading them (0: keep all hashes)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.scaled);
+
+    parser.add_argument("--largest-first")
+        .help("Read the largest sketch files first, to balance the threads when file sizes vary a lot")
+        .flag()
+        .store_into(arguments.largest_first);
+
+    parser.add_argument("--io-threads")
+        .help("The number of extra threads reading sketch files ahead of the parsing threads (0: parsing threads read)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.io_threads);
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::runtime_error &err) {
+        std::cout << err.what() << std::endl;
+        std::cout << parser;
+        exit(1);
+    }
+
+}
+
+
+
+void show_args(Arguments &args) {
+    cout << "**************************************" << endl;
+    cout << "*" << endl;
+    cout << "*   Filelist: " << args.filelist << endl;
+    cout << "*   Output filename: " << args.output_filename << endl;
+    cout << "*   Number of threads: " << args.number_of_threads << endl;
+    cout << "*   ksize: " << args.ksize << endl;
+    cout << "*   Seed: " << args.seed << endl;
+    cout << "*   Scaled: " << args.scaled << endl;
+    cout << "*   Largest files first: " << (args.largest_first ? "yes" : "no") << endl;
+    cout << "*   Number of I/O threads: " << args.io_threads << endl;
+    cout << "*" << endl;
+    cout << "**************************************" << endl;
+}
+
+
+
+int main( int argc, char** argv ) {
+
+    Arguments arguments;
+    parse_args(argc, argv, arguments);
+    show_args(arguments);
+    do_pack(arguments);
+
+    return 0;
+
+}
@@ -1,7 +1,7 @@
 #include "argparse.hpp"
 #include "json.hpp"
 #include "utils.h"
-#include "MultiSketchIndex.h"
+#include "FrozenSketchIndex.h"
 
 #include <iostream>
 #include <fstream>
@@ -36,6 +36,15 @@ struct Arguments {
     int number_of_threads;
     int threshold_bp;
     int num_hashtables;
+    bool compress_postings;
+    string key_layout;
+    string index_path;
+    int ksize;
+    int seed;
+    int scaled;
+    bool largest_first;
+    int io_threads;
+    bool lazy_metadata;
 };
 
 
@@ -50,14 +59,24 @@ void do_prefetch(Arguments& args) {
     vector<string> ref_sketch_paths;
     vector<Sketch> ref_sketches;
     vector<int> empty_sketch_ids;
-    MultiSketchIndex ref_index(args.num_hashtables);
+    FrozenSketchIndex ref_index(args.compress_postings ? POSTINGS_STREAMVBYTE : POSTINGS_RAW, 
+                                    key_layout_from_name(args.key_layout));
+    SketchLoadOptions load_options;
+    load_options.ksize = args.ksize;
+    load_options.seed = args.seed;
+    load_options.scaled = args.scaled;
+    load_options.largest_first = args.largest_first;
+    load_options.io_threads = args.io_threads;
+    load_options.lazy_metadata = args.lazy_metadata;
 
     // Read the query sketch and the reference sketches
     auto read_start = chrono::high_resolution_clock::now();
     cout << "Reading all reference sketches and the query sketch using " << args.number_of_threads << " threads" << endl;
-    query_sketch = read_min_hashes(args.query_path);
+    SketchLoadOptions query_load_options = load_options;
+    query_load_options.lazy_metadata = false;
+    query_sketch = read_min_hashes(args.query_path, query_load_options);
     get_sketch_paths(args.ref_filelist, ref_sketch_paths);
-    read_sketches(ref_sketch_paths, ref_sketches, empty_sketch_ids, args.number_of_threads);
+    read_sketches(ref_sketch_paths, ref_sketches, empty_sketch_ids, args.number_of_threads, load_options);
     
     // read complete, show time taken
     auto read_end = chrono::high_resolution_clock::now();
@@ -75,16 +94,28 @@ void do_prefetch(Arguments& args) {
     cout << "Number of kmers in query: " << query_sketch.size() << endl;
     cout << "Number of kmers in all the references: " << num_total_hashes_in_ref << endl;
 
-    // Compute the index from the reference sketches
+    // Compute the index from the reference sketches, or load a saved one
     auto start = chrono::high_resolution_clock::now();
-    cout << "Building an index on all the reference kmers... (will take some time)" << endl;
-    compute_index_from_sketches(ref_sketches, ref_index, args.number_of_threads);
+    bool index_loaded = false;
+    if (args.index_path.empty()) {
+        cout << "Building an index on all the reference kmers... (will take some time)" << endl;
+        compute_index_from_sketches(ref_sketches, ref_index, args.number_of_threads);
+    } else {
+        index_loaded = load_or_compute_index(ref_sketches, ref_index, args.index_path, args.number_of_threads);
+    }
     auto end = chrono::high_resolution_clock::now();
     auto duration_in_seconds = chrono::duration_cast<chrono::seconds>(end - start);
-    cout << "Index building completed in " << duration_in_seconds.count() << " seconds." << endl;
+    cout << (index_loaded ? "Index loading" : "Index building") << " completed in " << duration_in_seconds.count() << " seconds." << endl;
 
     // show num of hashes in ref
     cout << "Number of distinct kmers in the references: " << ref_index.size() << endl;
+    cout << "Index size in memory: " << ref_index.memory_usage() / (1024.0 * 1024.0) << " MB" << endl;
+    cout << "Index keys: " << KEY_LAYOUT_NAMES[ref_index.keys_layout()] << endl;
+    // a query hash absent from the references may still hit a slot, and count its references
+    if (ref_index.keys_layout() == KEYS_MPHF) {
+        cerr << "Warning: the index has mphf keys, so the intersection counts are approximate "
+                << "(an absent hash matches with probability 2^-16)" << endl;
+    }
 
     // start prefetch
     cout << "Now searching the query kmers against the reference kmers..." << endl;
@@ -93,16 +124,15 @@ void do_prefetch(Arguments& args) {
         num_intersection_values[i] = 0;
     }
 
-    for (hash_t hash_value : query_sketch.hashes) {
-        vector<int> matching_ref_ids = ref_index.get_sketch_indices(hash_value);
-        for (int ref_id : matching_ref_ids) {
+    ref_index.lookup_batch(query_sketch.data(), query_sketch.size(), [&](size_t, PostingView matching_ref_ids) {
+        matching_ref_ids.for_each([&](int ref_id) {
             num_intersection_values[ref_id]++;
-        }
-    }
+        });
+    });
     
     // now sort the ref sketches based on the number of intersections
     vector<tuple<int, size_t>> ref_id_num_intersections;
-    for (int i = 0; i < ref_sketches.size(); i++) {
+    for (int i = 0; i < (int)ref_sketches.size(); i++) {
         ref_id_num_intersections.push_back(make_tuple(i, num_intersection_values[i]));
     }
 
@@ -117,7 +147,7 @@ void do_prefetch(Arguments& args) {
     for (auto ref_id_num_intersection : ref_id_num_intersections) {
         int ref_id = get<0>(ref_id_num_intersection);
         size_t num_intersection = get<1>(ref_id_num_intersection);
-        if (num_intersection < args.threshold_bp) {
+        if (num_intersection < (size_t)args.threshold_bp) {
             break;
         }
         double containment_query_ref = 1.0 * num_intersection / query_sketch.size();
@@ -168,11 +198,64 @@ void parse_args(int argc, char** argv, Arguments &arguments) {
         .store_into(arguments.threshold_bp);
 
     parser.add_argument("-n", "--num-hashtables")
-        .help("The number of hash tables to use")
+        .help("Deprecated, has no effect: the index is no longer split into hash tables")
         .scan<'i', int>()
         .default_value(4096)
         .store_into(arguments.num_hashtables);
 
+    parser.add_argument("--compress-postings")
+        .help("Store the posting lists of the index compressed (smaller index, slightly slower lookups)")
+        .flag()
+        .store_into(arguments.compress_postings);
+
+    parser.add_argument("--keys")
+        .help("How the index stores the distinct hashes: sorted (32-bit keys when dense enough), "
+                "directory (fastest lookups, 32-bit keys when they fit), elias-fano (compact) or mphf "
+                "(smallest, approximate counts: absent hashes match with probability 2^-16)")
+        .choices("sorted", "directory", "elias-fano", "mphf")
+        .default_value(string("sorted"))
+        .store_into(arguments.key_layout);
+
+    parser.add_argument("--index")
+        .help("Load the index from this file, or build it and save it there if the file does not exist "
+                "(--compress-postings and --keys only apply when building)")
+        .default_value(string(""))
+        .store_into(arguments.index_path);
+
+    parser.add_argument("-k", "--ksize")
+        .help("Only use signatures with this ksize (0: use all signatures)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.ksize);
+
+    parser.add_argument("-s", "--seed")
+        .help("Only use signatures with this seed (-1: any seed)")
+        .scan<'i', int>()
+        .default_value(-1)
+        .store_into(arguments.seed);
+
+    parser.add_argument("--scaled")
+        .help("Downsample the sketches to this scaled while reading them (0: keep all hashes)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.scaled);
+
+    parser.add_argument("--largest-first")
+        .help("Read the largest sketch files first, to balance the threads when file sizes vary a lot")
+        .flag()
+        .store_into(arguments.largest_first);
+
+    parser.add_argument("--io-threads")
+        .help("The number of extra threads reading sketch files ahead of the parsing threads (0: parsing threads read)")
+        .scan<'i', int>()
+        .default_value(0)
+        .store_into(arguments.io_threads);
+
+    parser.add_argument("--lazy-metadata")
+        .help("Do not keep names and md5s of the references in memory, read them again for the matches only")
+        .flag()
+        .store_into(arguments.lazy_metadata);
+
     try {
         parser.parse_args(argc, argv);
     } catch (const std::runtime_error &err) {
@@ -180,6 +263,10 @@ void parse_args(int argc, char** argv, Arguments &arguments) {
         std::cout << parser;
         exit(1);
     }
+
+    if (parser.is_used("--num-hashtables")) {
+        std::cerr << "Warning: --num-hashtables is deprecated and has no effect" << std::endl;
+    }
 }
 
 
@@ -192,7 +279,15 @@ void show_args(Arguments &args) {
     cout << "*   Output filename: " << args.output_filename << endl;
     cout << "*   Number of threads: " << args.number_of_threads << endl;
     cout << "*   Threshold in base pairs: " << args.threshold_bp << endl;
-    cout << "*   Number of hash tables in the index: " << args.num_hashtables << endl;
+    cout << "*   Compressed posting lists: " << (args.compress_postings ? "yes" : "no") << endl;
+    cout << "*   Index keys: " << args.key_layout << endl;
+    cout << "*   Saved index: " << (args.index_path.empty() ? "none" : args.index_path) << endl;
+    cout << "*   ksize: " << args.ksize << endl;
+    cout << "*   Seed: " << args.seed << endl;
+    cout << "*   Scaled: " << args.scaled << endl;
+    cout << "*   Largest files first: " << (args.largest_first ? "yes" : "no") << endl;
+    cout << "*   Number of I/O threads: " << args.io_threads << endl;
+    cout << "*   Lazy metadata: " << (args.lazy_metadata ? "yes" : "no") << endl;
     cout << "*" << endl;
     cout << "**************************************" << endl;
 } 
@@ -1,135 +1,458 @@
 #include "utils.h"
 
-Sketch read_min_hashes(const std::string& json_filename) {
+// zip collections are opened once and shared by all the threads reading their members
+static std::mutex zip_archives_mutex;
+static std::map<std::string, std::unique_ptr<ZipArchive>> zip_archives;
+
+
+static const ZipArchive* get_zip_archive(const std::string& archive_path) {
+    std::lock_guard<std::mutex> lock(zip_archives_mutex);
+    auto it = zip_archives.find(archive_path);
+    if (it == zip_archives.end()) {
+        std::unique_ptr<ZipArchive> archive(new ZipArchive());
+        if (!archive->open(archive_path)) {
+            archive.reset();
+        }
+        it = zip_archives.emplace(archive_path, std::move(archive)).first;
+    }
+    return it->second.get();
+}
 
-    // Open the JSON file
-    std::ifstream inputFile(json_filename);
 
-    // Check if the file is open
-    if (!inputFile.is_open()) {
-        std::cerr << "Could not open the file!" << std::endl;
-        return {};
+static bool is_signature_member(const std::string& name) {
+    for (const std::string suffix : {".sig", ".sig.gz", ".json", ".json.gz"}) {
+        if (name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            return true;
+        }
     }
+    return false;
+}
 
-    // Parse the JSON data
-    json jsonData;
-    inputFile >> jsonData;
 
-    // Access and print values
-    std::vector<hash_t> min_hashes = jsonData[0]["signatures"][0]["mins"];
-    std::string name = jsonData[0]["name"];
-    std::string md5 = jsonData[0]["signatures"][0]["md5sum"];
-    int ksize = jsonData[0]["signatures"][0]["ksize"];
-    hash_t max_hash = jsonData[0]["signatures"][0]["max_hash"];
-    int seed = jsonData[0]["signatures"][0]["seed"];
+static bool add_zip_member_paths(const std::string& archive_path, std::vector<std::string>& sketch_paths) {
+    const ZipArchive* archive = get_zip_archive(archive_path);
+    if (archive == nullptr) {
+        return false;
+    }
+    for (const ZipArchive::Entry& entry : archive->entries()) {
+        if (is_signature_member(entry.name)) {
+            sketch_paths.push_back(archive_path + ZIP_MEMBER_SEPARATOR + entry.name);
+        }
+    }
+    return true;
+}
 
-    // Close the file
-    inputFile.close();
 
-    Sketch sketch(min_hashes, json_filename, name, md5, ksize, max_hash, seed);
-    return sketch;
+// returns the number of signatures in the buffer, kept or not
+static int read_signatures_from_buffer(const char* data, size_t size, const std::string& json_filename,
+                                        const SketchLoadOptions& options, std::vector<Sketch>& sketches,
+                                        int first_signature_index = 0) {
+
+    // Parse the JSON data, mins go straight into the hashes of the sketches
+    SignatureSaxHandler handler(sketches, json_filename, options, first_signature_index);
+    if (is_gzip(data, size)) {
+        // inflate the compressed contents straight from memory
+        std::string json_text;
+        if (!inflate_buffer(data, size, Inflater::GZIP, json_text)) {
+            std::cerr << "Could not decompress the file: " << json_filename << std::endl;
+            return 0;
+        }
+        parse_signature_buffer(json_text.data(), json_text.size(), handler);
+    } else {
+        parse_signature_buffer(data, size, handler);
+    }
+    return handler.num_signatures;
 
 }
 
 
-/*
-Is there a way to make this function more efficient?
-Say we have n threads
-Each thread handles some sketches
-To store the hash value h,
-we will need to lock mutex_list[ get_mutex_index(h) ]
-then push_back the index to the vector
-then unlock the mutex
-should be many times faster??
-*/
+static int read_zip_member(const ZipArchive* archive, size_t entry_id, const std::string& json_filename,
+                            const SketchLoadOptions& options, std::vector<Sketch>& sketches,
+                            int first_signature_index = 0) {
+    std::string buffer;
+    size_t size;
+    const char* contents = archive->read(entry_id, size, buffer);
+    if (contents == nullptr) {
+        std::cerr << "Could not read the zip member: " << json_filename << std::endl;
+        return 0;
+    }
+    return read_signatures_from_buffer(contents, size, json_filename, options, sketches, first_signature_index);
+}
+
 
+void read_signature_file(const std::string& json_filename, 
+                            const SketchLoadOptions& options, 
+                            std::vector<Sketch>& sketches) {
 
+    // A member of a zip collection
+    size_t separator_pos = json_filename.find(ZIP_MEMBER_SEPARATOR);
+    if (separator_pos != std::string::npos) {
+        const ZipArchive* archive = get_zip_archive(json_filename.substr(0, separator_pos));
+        if (archive != nullptr) {
+            long entry_id = archive->find(json_filename.substr(separator_pos + ZIP_MEMBER_SEPARATOR.size()));
+            if (entry_id < 0) {
+                std::cerr << "No such member in the zip collection: " << json_filename << std::endl;
+                return;
+            }
+            read_zip_member(archive, entry_id, json_filename, options, sketches);
+            return;
+        }
+    }
 
-void compute_index_from_sketches_one_chunk( int sketch_index_start, int sketch_index_end,
-                                        std::vector<Sketch>& sketches,
-                                        MultiSketchIndex& multi_sketch_index,
-                                        bool show_progress = false) {
+    // Map the JSON file into memory
+    MappedFile inputFile(json_filename);
 
+    // Check if the file is open
+    if (!inputFile.is_open()) {
+        std::cerr << "Could not open the file!" << std::endl;
+        return;
+    }
 
-    for (int i = sketch_index_start; i < sketch_index_end; i++) {
-        if (show_progress) {
-            double percentage = 100.0 * (i - sketch_index_start) / (sketch_index_end - sketch_index_start);
-            // show percetage progress, only two decimal points
-            std::cout << "\rProgress: " << std::fixed << std::setprecision(2) << percentage << "%";
+    // A zip collection: read all of its signatures
+    if (ZipArchive::is_zip(inputFile.data(), inputFile.size())) {
+        inputFile.close();
+        const ZipArchive* archive = get_zip_archive(json_filename);
+        if (archive == nullptr) {
+            std::cerr << "Could not read the zip collection: " << json_filename << std::endl;
+            return;
         }
-        for (uint j = 0; j < sketches[i].size(); j++) {
-            hash_t hash_value = sketches[i][j];
-            multi_sketch_index.add_hash(hash_value, i);
+        // signatures are numbered across all the members
+        int num_signatures = 0;
+        for (size_t i = 0; i < archive->entries().size(); i++) {
+            if (is_signature_member(archive->entries()[i].name)) {
+                num_signatures += read_zip_member(archive, i, json_filename + ZIP_MEMBER_SEPARATOR + archive->entries()[i].name, 
+                                                    options, sketches, num_signatures);
+            }
         }
+        return;
     }
 
-    if (show_progress) {
-        std::cout << "\rProgress: " << std::fixed << std::setprecision(2) << 100.00 << "%";
-        std::cout << std::endl;
+    // A packed sketch store: use the hashes in place
+    if (is_sketch_store(inputFile.data(), inputFile.size())) {
+        inputFile.close();
+        if (!read_sketch_store(json_filename, options, sketches)) {
+            std::cerr << "Could not read the sketch store: " << json_filename << std::endl;
+        }
+        return;
     }
 
+    read_signatures_from_buffer(inputFile.data(), inputFile.size(), json_filename, options, sketches);
 
-}   
+}
 
 
+void load_sketch_metadata(Sketch& sketch, const std::vector<std::string>& sketch_paths) {
+    if (sketch.metadata_loaded || sketch.path_index < 0) {
+        return;
+    }
+    const std::string& sketch_path = sketch_paths[sketch.path_index];
+
+    // read the metadata of all signatures in the file, then pick ours
+    std::vector<Sketch> file_sketches;
+    if (is_sketch_store_file(sketch_path)) {
+        Sketch stored;
+        if (read_sketch_store_metadata(sketch_path, sketch.signature_index, stored)) {
+            file_sketches.push_back(std::move(stored));
+        }
+    } else {
+        SketchLoadOptions metadata_options;
+        metadata_options.metadata_only = true;
+        read_signature_file(sketch_path, metadata_options, file_sketches);
+        if (sketch.signature_index < (int)file_sketches.size()) {
+            std::swap(file_sketches[0], file_sketches[sketch.signature_index]);
+            file_sketches.resize(1);
+        } else {
+            file_sketches.clear();
+        }
+    }
 
-void compute_index_from_sketches(std::vector<Sketch>& sketches, 
-                                    MultiSketchIndex& multi_sketch_index,
-                                    const int num_threads) {
-    
-    
-    // create threads
-    int num_sketches = sketches.size();
-    int chunk_size = num_sketches / num_threads;
-    std::vector<std::thread> threads;
-    for (int i = 0; i < num_threads; i++) {
-        int start_index = i * chunk_size;
-        int end_index = (i == num_threads - 1) ? num_sketches : (i + 1) * chunk_size;
-        bool show_progress = (i == num_threads - 1);
-        threads.push_back(std::thread(compute_index_from_sketches_one_chunk, 
-                                        start_index, end_index, 
-                                        std::ref(sketches), std::ref(multi_sketch_index), show_progress));
+    if (file_sketches.empty()) {
+        std::cerr << "Could not load the metadata of a sketch from: " << sketch_path << std::endl;
+        return;
     }
+    sketch.name = std::move(file_sketches[0].name);
+    sketch.md5 = std::move(file_sketches[0].md5);
+    sketch.file_path = std::move(file_sketches[0].file_path);
+    sketch.metadata_loaded = true;
+}
+
 
-    // join threads
-    for (int i = 0; i < num_threads; i++) {
-        threads[i].join();
+Sketch read_min_hashes(const std::string& json_filename, const SketchLoadOptions& options) {
+    std::vector<Sketch> sketches;
+    read_signature_file(json_filename, options, sketches);
+    if (sketches.empty()) {
+        return {};
     }
+    return std::move(sketches[0]);
+}
 
 
+void compute_index_from_sketches(std::vector<Sketch>& sketches, 
+                                    FrozenSketchIndex& frozen_sketch_index,
+                                    const int num_threads) {
+    frozen_sketch_index.build(sketches, num_threads);
+}
+
+
+
+
+bool load_or_compute_index(std::vector<Sketch>& sketches, 
+                            FrozenSketchIndex& frozen_sketch_index,
+                            const std::string& index_path,
+                            int num_threads) {
+    struct stat file_stat;
+    if (stat(index_path.c_str(), &file_stat) != 0) {
+        std::cout << "No index at " << index_path << ", building it... (will take some time)" << std::endl;
+        compute_index_from_sketches(sketches, frozen_sketch_index, num_threads);
+        if (!frozen_sketch_index.save(index_path)) {
+            exit(1);
+        }
+        std::cout << "Index saved to " << index_path << std::endl;
+        return false;
+    }
+
+    std::cout << "Loading the index from " << index_path << std::endl;
+    if (!frozen_sketch_index.load(index_path)) {
+        std::cerr << "Not a saved index: " << index_path << std::endl;
+        exit(1);
+    }
+    size_t num_hashes = 0;
+    for (const Sketch& sketch : sketches) {
+        num_hashes += sketch.size();
+    }
+    if (frozen_sketch_index.num_sketches() != sketches.size() || frozen_sketch_index.num_postings() != num_hashes) {
+        std::cerr << "The index at " << index_path << " was built from other sketches ("
+                    << frozen_sketch_index.num_sketches() << " sketches and " << frozen_sketch_index.num_postings() 
+                    << " hashes, not " << sketches.size() << " and " << num_hashes << ")" << std::endl;
+        exit(1);
+    }
+    if (frozen_sketch_index.sketches_fingerprint() != FrozenSketchIndex::fingerprint_of(sketches, num_threads)) {
+        std::cerr << "The index at " << index_path << " was built from other sketches, or from the same "
+                    << "sketches in another order (their fingerprints differ)" << std::endl;
+        exit(1);
+    }
+    return true;
 }
 
 
 
 void get_sketch_paths(const std::string& filelist, std::vector<std::string>& sketch_paths) {
-    // the filelist is a file, where each line is a path to a sketch file
-    std::ifstream file(filelist);
+    MappedFile file(filelist);
     if (!file.is_open()) {
         std::cerr << "Could not open the filelist: " << filelist << std::endl;
         return;
     }
-    std::string line;
-    while (std::getline(file, line)) {
+
+    // a packed sketch store is read as a whole by read_sketches
+    if (is_sketch_store(file.data(), file.size())) {
+        sketch_paths.push_back(filelist);
+        return;
+    }
+
+    // a zip collection instead of a filelist
+    if (ZipArchive::is_zip(file.data(), file.size())) {
+        file.close();
+        if (!add_zip_member_paths(filelist, sketch_paths)) {
+            std::cerr << "Could not read the zip collection: " << filelist << std::endl;
+        }
+        return;
+    }
+
+    // the filelist is a file, where each line is a path to a sketch file (or a zip collection)
+    const char* line_start = file.data();
+    const char* end = file.data() + file.size();
+    while (line_start < end) {
+        const char* line_end = std::find(line_start, end, '\n');
+        std::string line(line_start, line_end);
+        line_start = line_end + 1;
+        // opening the archive checks that it is one, a file which is not stays a sketch path
+        if (line.size() > 4 && line.compare(line.size() - 4, 4, ".zip") == 0 && add_zip_member_paths(line, sketch_paths)) {
+            continue;
+        }
         sketch_paths.push_back(line);
     }
 }
 
 
 
-void read_sketches_one_chunk(int start_index, int end_index, 
-                            std::vector<std::string>& sketch_paths,
-                            std::vector<Sketch>& sketches,
-                            std::mutex& mutex_count_empty_sketch,
-                            std::vector<int>& empty_sketch_ids) {
+// run work(i) for all 0 <= i < num_items, threads take the next item from a shared cursor
+static void run_dynamic(size_t num_items, uint num_threads, const std::function<void(size_t)>& work) {
+    std::atomic<size_t> cursor(0);
+    std::vector<std::thread> threads;
+    for (uint t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([&]() {
+            for (size_t i = cursor.fetch_add(1); i < num_items; i = cursor.fetch_add(1)) {
+                work(i);
+            }
+        }));
+    }
+    for (uint t = 0; t < num_threads; t++) {
+        threads[t].join();
+    }
+}
+
+
+
+// size of the data behind a sketch path, 0 if unknown
+static size_t sketch_file_size(const std::string& sketch_path) {
+    size_t separator_pos = sketch_path.find(ZIP_MEMBER_SEPARATOR);
+    if (separator_pos != std::string::npos) {
+        const ZipArchive* archive = get_zip_archive(sketch_path.substr(0, separator_pos));
+        if (archive != nullptr) {
+            long entry_id = archive->find(sketch_path.substr(separator_pos + ZIP_MEMBER_SEPARATOR.size()));
+            return entry_id < 0 ? 0 : archive->entries()[entry_id].compressed_size;
+        }
+    }
+    struct stat file_stat;
+    if (stat(sketch_path.c_str(), &file_stat) != 0) {
+        return 0;
+    }
+    return file_stat.st_size;
+}
+
+
+
+// a file read by the I/O threads, waiting for a parser thread
+struct FileBuffer {
+    size_t path_index;
+    bool read_by_parser;    // zip members, zip collections and sketch stores are not read ahead
+    std::string contents;
+};
+
+
+
+// a queue with a fixed capacity, push blocks while it is full and pop blocks while it is empty
+template <typename T>
+class BoundedQueue {
+    public:
+        BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+        void push(T item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [&]() { return items.size() < capacity; });
+            items.push_back(std::move(item));
+            not_empty.notify_one();
+        }
+
+        // false once the queue is closed and drained
+        bool pop(T& item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [&]() { return !items.empty() || closed; });
+            if (items.empty()) {
+                return false;
+            }
+            item = std::move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            not_empty.notify_all();
+        }
+
+    private:
+        size_t capacity;
+        bool closed;
+        std::deque<T> items;
+        std::mutex mutex;
+        std::condition_variable not_full;
+        std::condition_variable not_empty;
+};
+
+
 
-    for (int i = start_index; i < end_index; i++) {
-        auto min_hashes = read_min_hashes(sketch_paths[i]);
-        sketches[i] = min_hashes;
-        if (sketches[i].size() == 0) {
-            mutex_count_empty_sketch.lock();
-            empty_sketch_ids.push_back(i);
-            mutex_count_empty_sketch.unlock();
+// read a whole regular file, false if it should be left to the parser (or cannot be read)
+static bool read_ahead_file(const std::string& file_path, std::string& contents) {
+    if (file_path.find(ZIP_MEMBER_SEPARATOR) != std::string::npos) {
+        return false;
+    }
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // the first read is small: archives and stores are mapped by the parser instead
+    const size_t first_read_size = 1 << 16;
+    contents.resize(file_stat.st_size);
+    size_t num_read = 0;
+    while (num_read < contents.size()) {
+        size_t read_size = contents.size() - num_read;
+        if (num_read == 0 && read_size > first_read_size) {
+            read_size = first_read_size;
+        }
+        ssize_t n = pread(fd, &contents[num_read], read_size, num_read);
+        if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        if (num_read == 0 && (is_sketch_store(contents.data(), n) || ZipArchive::is_zip(contents.data(), n))) {
+            close(fd);
+            return false;
         }
+        num_read += n;
+    }
+    close(fd);
+    return true;
+}
+
+
+
+// I/O threads read whole files ahead into a bounded queue, parser threads parse from memory
+static void read_sketches_pipelined(std::vector<std::string>& sketch_paths,
+                                    const std::vector<size_t>& read_order,
+                                    std::vector<std::vector<Sketch>>& sketches_by_path,
+                                    const uint num_threads,
+                                    const SketchLoadOptions& options) {
+
+    BoundedQueue<FileBuffer> queue(4 * (options.io_threads + num_threads));
+    std::atomic<size_t> cursor(0);
+
+    std::vector<std::thread> io_threads;
+    for (int t = 0; t < options.io_threads; t++) {
+        io_threads.push_back(std::thread([&]() {
+            for (size_t i = cursor.fetch_add(1); i < read_order.size(); i = cursor.fetch_add(1)) {
+                FileBuffer file_buffer;
+                file_buffer.path_index = read_order[i];
+                file_buffer.read_by_parser = !read_ahead_file(sketch_paths[file_buffer.path_index], file_buffer.contents);
+                if (file_buffer.read_by_parser) {
+                    file_buffer.contents.clear();
+                }
+                queue.push(std::move(file_buffer));
+            }
+        }));
+    }
+
+    std::vector<std::thread> parser_threads;
+    for (uint t = 0; t < num_threads; t++) {
+        parser_threads.push_back(std::thread([&]() {
+            FileBuffer file_buffer;
+            while (queue.pop(file_buffer)) {
+                const std::string& path = sketch_paths[file_buffer.path_index];
+                std::vector<Sketch>& path_sketches = sketches_by_path[file_buffer.path_index];
+                if (file_buffer.read_by_parser) {
+                    read_signature_file(path, options, path_sketches);
+                } else {
+                    read_signatures_from_buffer(file_buffer.contents.data(), file_buffer.contents.size(), 
+                                                path, options, path_sketches);
+                }
+            }
+        }));
+    }
+
+    for (std::thread& thread : io_threads) {
+        thread.join();
+    }
+    queue.close();
+    for (std::thread& thread : parser_threads) {
+        thread.join();
     }
 }
 
@@ -138,27 +461,55 @@ void read_sketches_one_chunk(int start_index, int end_index,
 void read_sketches(std::vector<std::string>& sketch_paths,
                         std::vector<Sketch>& sketches, 
                         std::vector<int>& empty_sketch_ids, 
-                        const uint num_threads) {
+                        const uint num_threads,
+                        const SketchLoadOptions& options) {
+
+    // a file may hold any number of signatures, collect them per file first
+    uint num_paths = sketch_paths.size();
+    std::vector<std::vector<Sketch>> sketches_by_path(num_paths);
 
-    uint num_sketches = sketch_paths.size();
-    for (uint i = 0; i < num_sketches; i++) {
-        sketches.push_back( Sketch() );
+    // the order in which files are handed out to the threads
+    std::vector<size_t> read_order(num_paths);
+    for (size_t i = 0; i < num_paths; i++) {
+        read_order[i] = i;
+    }
+    if (options.largest_first) {
+        // start with the largest files, so that no thread is left with a big file at the end
+        std::vector<size_t> file_sizes(num_paths);
+        run_dynamic(num_paths, num_threads, [&](size_t i) {
+            file_sizes[i] = sketch_file_size(sketch_paths[i]);
+        });
+        std::stable_sort(read_order.begin(), read_order.end(), [&](size_t a, size_t b) {
+            return file_sizes[a] > file_sizes[b];
+        });
     }
 
-    std::mutex mutex_count_empty_sketch;
-    int chunk_size = num_sketches / num_threads;
-    std::vector<std::thread> threads;
-    for (int i = 0; i < num_threads; i++) {
-        int start_index = i * chunk_size;
-        int end_index = (i == num_threads - 1) ? num_sketches : (i + 1) * chunk_size;
-        threads.push_back(std::thread(read_sketches_one_chunk, 
-                                        start_index, end_index, 
-                                        std::ref(sketch_paths), std::ref(sketches), 
-                                        std::ref(mutex_count_empty_sketch), 
-                                        std::ref(empty_sketch_ids)));
-    }
-    for (int i = 0; i < num_threads; i++) {
-        threads[i].join();
+    if (options.io_threads == 0) {
+        // each thread takes the next file as soon as it is done with the previous one
+        run_dynamic(num_paths, num_threads, [&](size_t i) {
+            size_t path_index = read_order[i];
+            read_signature_file(sketch_paths[path_index], options, sketches_by_path[path_index]);
+        });
+    } else {
+        read_sketches_pipelined(sketch_paths, read_order, sketches_by_path, num_threads, options);
+    }
+
+    // flatten in file order. a file which yields no sketch (unreadable, or no signature
+    // passes the load options) still gets an empty sketch, so that the ids of the
+    // following files do not shift and the file is reported as empty
+    for (uint i = 0; i < num_paths; i++) {
+        if (sketches_by_path[i].empty()) {
+            Sketch placeholder;
+            placeholder.file_path = sketch_paths[i];
+            sketches_by_path[i].push_back(std::move(placeholder));
+        }
+        for (Sketch& sketch : sketches_by_path[i]) {
+            sketch.path_index = i;
+            if (sketch.size() == 0) {
+                empty_sketch_ids.push_back(sketches.size());
+            }
+            sketches.push_back(std::move(sketch));
+        }
     }
     
 }
@@ -187,30 +538,26 @@ void compute_intersection_matrix_by_sketches(int query_sketch_start_index, int q
                                             int pass_id, int negative_offset,
                                             std::vector<Sketch>& sketches_query,
                                             std::vector<Sketch>& sketches_ref,
-                                            MultiSketchIndex& multi_sketch_index_ref,
+                                            const FrozenSketchIndex& sketch_index_ref,
                                             int** intersectionMatrix, 
                                             double containment_threshold,
                                             std::vector<std::vector<int>>& similars,
                                             bool show_progress = false) {
     
     const int num_sketches_ref = sketches_ref.size();
-    const int num_sketches_query = sketches_query.size();
 
     // process the sketches in the range [sketch_start_index, sketch_end_index)
     if (show_progress) {
         std::cout << "Computation progress: 0.00%";
     }
-    for (uint i = query_sketch_start_index; i < query_sketch_end_index; i++) {
-        for (int j = 0; j < sketches_query[i].size(); j++) {
-            hash_t hash = sketches_query[i][j];
-            if (!multi_sketch_index_ref.hash_exists(hash)) {
-                continue;
-            }
-            std::vector<int> ref_sketch_indices = multi_sketch_index_ref.get_sketch_indices(hash);
-            for (uint k = 0; k < ref_sketch_indices.size(); k++) {
-                intersectionMatrix[i-negative_offset][ref_sketch_indices[k]]++;
-            }
-        }
+    for (int i = query_sketch_start_index; i < query_sketch_end_index; i++) {
+        int* intersection_row = intersectionMatrix[i-negative_offset];
+        sketch_index_ref.lookup_batch(sketches_query[i].data(), sketches_query[i].size(), 
+                                        [intersection_row](size_t, PostingView ref_sketch_indices) {
+            ref_sketch_indices.for_each([intersection_row](int ref_sketch_index) {
+                intersection_row[ref_sketch_index]++;
+            });
+        });
         if (show_progress) {
             double percentage = 100.0 * (i - query_sketch_start_index) / (query_sketch_end_index - query_sketch_start_index);
             // show percetage progress, only two decimal points
@@ -242,7 +589,7 @@ void compute_intersection_matrix_by_sketches(int query_sketch_start_index, int q
         std::cout << "Writing progress: 0.00%";
     }
     for (int i = query_sketch_start_index; i < query_sketch_end_index; i++) {
-        for (uint j = 0; j < num_sketches_ref; j++) {
+        for (int j = 0; j < num_sketches_ref; j++) {
             // if nothing in the intersection, then skip
             if (intersectionMatrix[i-negative_offset][j] == 0) {
                 continue;
@@ -297,7 +644,7 @@ void compute_intersection_matrix_by_sketches(int query_sketch_start_index, int q
 
 void compute_intersection_matrix(std::vector<Sketch>& sketches_query,
                                 std::vector<Sketch>& sketches_ref, 
-                                MultiSketchIndex& multi_sketch_index_ref,
+                                const FrozenSketchIndex& sketch_index_ref,
                                 std::string& out_dir, 
                                 std::vector<std::vector<int>>& similars,
                                 double containment_threshold,
@@ -314,7 +661,7 @@ void compute_intersection_matrix(std::vector<Sketch>& sketches_query,
     }
 
     // allocate memory for the similars if not already allocated
-    if (similars.size() != num_sketches_query) {
+    if (similars.size() != (size_t)num_sketches_query) {
         similars.clear();
         similars.resize(num_sketches_query);
     }
@@ -323,7 +670,7 @@ void compute_intersection_matrix(std::vector<Sketch>& sketches_query,
     for (int pass_id = 0; pass_id < num_passes; pass_id++) {
         // set zeros in the intersection matrix
         for (int i = 0; i < num_query_sketches_each_pass+1; i++) {
-            for (uint j = 0; j < num_sketches_ref; j++) {
+            for (int j = 0; j < num_sketches_ref; j++) {
                 intersectionMatrix[i][j] = 0;
             }
         }
@@ -345,7 +692,7 @@ void compute_intersection_matrix(std::vector<Sketch>& sketches_query,
                             start_query_index_this_thread, end_query_index_this_thread, 
                             i, out_dir, pass_id, negative_offset,
                             std::ref(sketches_query), std::ref(sketches_ref), 
-                            std::ref(multi_sketch_index_ref), 
+                            std::cref(sketch_index_ref), 
                             intersectionMatrix, containment_threshold, 
                             std::ref(similars), i == num_threads - 1);
             threads.emplace_back(std::move(t));
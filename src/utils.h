@@ -12,6 +12,7 @@
 #include <utility>
 #include <set>
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <cmath>
@@ -20,10 +21,23 @@
 #include <sstream>
 #include <chrono>
 #include <random>
+#include <atomic>
+#include <functional>
+#include <deque>
+#include <condition_variable>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "json.hpp"
-#include "MultiSketchIndex.h"
+#include "FrozenSketchIndex.h"
 #include "Sketch.h"
+#include "SignatureParser.h"
+#include "MappedFile.h"
+#include "Inflater.h"
+#include "ZipArchive.h"
+#include "SketchStore.h"
 
 using json = nlohmann::json;
 
@@ -33,17 +47,70 @@ typedef unsigned long long int hash_t;
 #endif
 
 
+// members of zip collections are referred to as <archive path>::<member name>
+const std::string ZIP_MEMBER_SEPARATOR = "::";
+
+
 
 
 
 /**
  * @brief Read the min-hashes from a FMH sketch file
  * 
- * Assumption: the file is a json file, and its not gzipped
+ * Assumption: the file is a json file, either plain or gzipped (detected by 
+ * the gzip magic bytes, not the extension). The path can also name a member
+ * of a zip collection (<archive path>::<member name>), or a zip collection
+ * itself, in which case its first signature is read, or a packed sketch store
+ * (see SketchStore.h).
+ * The file is memory mapped, the mins are decoded with a vectorized kernel 
+ * and the remaining fields are read with a SAX parser, no json DOM is built.
+ * 
+ * Only the first signature which passes the load options is returned, an 
+ * empty sketch if there is none.
  * 
  * @param sketch_path The path to the sketch file
+ * @param options Which signatures to consider
+ */
+Sketch read_min_hashes(const std::string& sketch_path, 
+                        const SketchLoadOptions& options = SketchLoadOptions());
+
+
+
+
+
+
+/**
+ * @brief Read all the signatures in a sketch file
+ * 
+ * Every signature of every record in the file which passes the load options
+ * is appended as one sketch, in file order. Accepts the same paths as 
+ * read_min_hashes (a zip collection yields the signatures of all its members,
+ * a packed sketch store yields all its sketches as views on the mapped store).
+ * 
+ * @param sketch_path The path to the sketch file
+ * @param options Which signatures to keep
+ * @param sketches The vector to append the sketches to
+ */
+void read_signature_file(const std::string& sketch_path, 
+                            const SketchLoadOptions& options, 
+                            std::vector<Sketch>& sketches);
+
+
+
+
+
+
+/**
+ * @brief Load the name, md5 and file path of a sketch read with lazy_metadata
+ * 
+ * The signature is found again in its file (only its metadata is parsed), or
+ * in the string table of its sketch store. Does nothing if the metadata is
+ * already loaded.
+ * 
+ * @param sketch The sketch, as returned by read_sketches
+ * @param sketch_paths The sketch paths given to read_sketches
  */
-Sketch read_min_hashes(const std::string& sketch_path);
+void load_sketch_metadata(Sketch& sketch, const std::vector<std::string>& sketch_paths);
 
 
 
@@ -51,14 +118,38 @@ Sketch read_min_hashes(const std::string& sketch_path);
 
 
 /**
- * @brief Compute the index from the sketches
+ * @brief Compute a read-only index from the sketches
  * 
  * @param sketches The sketches
- * @param hash_index The reference to the hash index (where the index will be stored)
+ * @param frozen_sketch_index The index to build
  * @param num_threads The number of threads to use
  */
 void compute_index_from_sketches(std::vector<Sketch>& sketches, 
-                            MultiSketchIndex& multi_sketch_index,
+                            FrozenSketchIndex& frozen_sketch_index,
+                            int num_threads);
+
+
+
+
+/**
+ * @brief Load a saved read-only index, or compute it from the sketches and save it
+ * 
+ * If the file index_path exists, it must be an index saved from the same 
+ * sketches: its number of sketches and hashes, and the fingerprint of the 
+ * hashes of the sketches in order (FrozenSketchIndex::fingerprint_of), must
+ * match. It is then memory mapped and used in place. Otherwise the index is 
+ * computed and saved to index_path, for the next runs. Exits if the file is 
+ * not a matching index or cannot be written.
+ * 
+ * @param sketches The sketches
+ * @param frozen_sketch_index The index to load or build
+ * @param index_path The path of the saved index
+ * @param num_threads The number of threads to use
+ * @return true If the index was loaded, false if it was computed
+ */
+bool load_or_compute_index(std::vector<Sketch>& sketches, 
+                            FrozenSketchIndex& frozen_sketch_index,
+                            const std::string& index_path,
                             int num_threads);
 
 
@@ -69,6 +160,10 @@ void compute_index_from_sketches(std::vector<Sketch>& sketches,
 /**
  * @brief Get the sketch paths 
  * 
+ * The filelist can also be a sourmash zip collection, and lines of the filelist
+ * can name zip collections. These are expanded to the paths of their members.
+ * A packed sketch store given as the filelist is kept as a single path.
+ * 
  * @param filelist The file containing the paths of the sketches
  * @param sketch_paths The vector to store the paths
  */
@@ -82,15 +177,27 @@ void get_sketch_paths(const std::string& filelist, std::vector<std::string>& ske
 /**
  * @brief Read the sketches from the sketch paths
  * 
+ * A file may contribute any number of sketches (all of its signatures which
+ * pass the load options), the sketches are stored in file order. A file which
+ * yields no sketch contributes one empty sketch, and its id is recorded in 
+ * empty_sketch_ids like that of any other empty sketch.
+ * Files are handed out to the threads one at a time (largest first if the load
+ * options ask for it), so threads stay busy until the last file is read.
+ * With options.io_threads > 0, dedicated I/O threads read whole files ahead 
+ * into a bounded queue and the num_threads parser threads only parse from 
+ * memory, so storage latency overlaps with parsing.
+ * 
  * @param sketch_paths The paths to the sketches
  * @param sketches The vector to store the sketches
  * @param empty_sketch_ids The vector to store the ids of empty sketches
  * @param num_threads The number of threads to use
+ * @param options Which signatures to keep
  */
 void read_sketches(std::vector<std::string>& sketch_paths,
                         std::vector<Sketch>& sketches, 
                         std::vector<int>& empty_sketch_ids, 
-                        const uint num_threads);
+                        const uint num_threads,
+                        const SketchLoadOptions& options = SketchLoadOptions());
 
 
 
@@ -111,7 +218,7 @@ void show_empty_sketches(const std::vector<int>&);
  * 
  * @param sketches_query The query sketches
  * @param sketches_ref The reference (target) sketches
- * @param hash_index_ref The index of the reference (target) sketches
+ * @param sketch_index_ref The index of the reference (target) sketches
  * @param out_dir The output directory to store the results
  * @param similars The vector to store the similar sketches
  * @param containment_threshold The containment threshold
@@ -121,7 +228,7 @@ void show_empty_sketches(const std::vector<int>&);
 
 void compute_intersection_matrix(std::vector<Sketch>& sketches_query,
                                 std::vector<Sketch>& sketches_ref, 
-                                MultiSketchIndex& multi_sketch_index_ref,
+                                const FrozenSketchIndex& sketch_index_ref,
                                 std::string& out_dir, 
                                 std::vector<std::vector<int>>& similars,
                                 double containment_threshold,
@@ -0,0 +1,234 @@
+// Tests of FrozenSketchIndex: every key layout and posting codec is built from a
+// few known sketches and checked against a map of the hash values to their
+// sketch indices, and against the index with POSTINGS_RAW lists and KEYS_SORTED keys.
+// Run with: make test
+
+#include <iostream>
+#include <map>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "FrozenSketchIndex.h"
+#include "Sketch.h"
+
+
+static int num_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        num_failures++;
+    }
+}
+
+
+
+// deterministic pseudo-random hash values (splitmix64)
+static hash_t next_hash(hash_t& state) {
+    hash_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+
+
+/*
+Known sketches: sketch i has hashes_per_sketch hash values of its own, the
+shared hash values j of the pool with j % (i + 1) == 0 (so the lists have all
+lengths) or i % 3000 == j (so that the lists of many sketches have indices
+above 65535), and hot_hash if i is below num_hot (a long list). The hash values
+are below 2^key_bits.
+*/
+static std::vector<Sketch> make_sketches(size_t num_sketches, size_t hashes_per_sketch, int key_bits,
+                                            size_t num_hot = 0) {
+    hash_t mask = key_bits == 64 ? ~0ULL : (1ULL << key_bits) - 1;
+    hash_t state = 42;
+    std::vector<hash_t> pool(32);
+    for (hash_t& hash_value : pool) {
+        hash_value = next_hash(state) & mask;
+    }
+    hash_t hot_hash = next_hash(state) & mask;
+
+    std::vector<Sketch> sketches;
+    for (size_t i = 0; i < num_sketches; i++) {
+        std::vector<hash_t> hashes;
+        for (size_t j = 0; j < hashes_per_sketch; j++) {
+            hashes.push_back(next_hash(state) & mask);
+        }
+        for (size_t j = 0; j < pool.size(); j++) {
+            if (j % (i + 1) == 0 || i % 3000 == j) {
+                hashes.push_back(pool[j]);
+            }
+        }
+        if (i < num_hot) {
+            hashes.push_back(hot_hash);
+        }
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+        std::string name = "sketch" + std::to_string(i);
+        sketches.emplace_back(hashes, name + ".sig", name, name, 31, 0, 42);
+    }
+    return sketches;
+}
+
+
+
+// the sketch indices of every hash value, in increasing order
+static std::map<hash_t, std::vector<int>> reference_of(const std::vector<Sketch>& sketches) {
+    std::map<hash_t, std::vector<int>> reference;
+    for (size_t i = 0; i < sketches.size(); i++) {
+        for (hash_t hash_value : sketches[i]) {
+            reference[hash_value].push_back((int)i);
+        }
+    }
+    return reference;
+}
+
+
+
+// hash values which are in none of the sketches
+static std::vector<hash_t> absent_hashes(const std::map<hash_t, std::vector<int>>& reference, int key_bits) {
+    hash_t mask = key_bits == 64 ? ~0ULL : (1ULL << key_bits) - 1;
+    hash_t state = 7;
+    std::vector<hash_t> absent;
+    while (absent.size() < 1000) {
+        hash_t hash_value = next_hash(state) & mask;
+        if (reference.count(hash_value) == 0) {
+            absent.push_back(hash_value);
+        }
+    }
+    return absent;
+}
+
+
+
+/**
+ * @brief Check find and PostingView::for_each against the reference.
+ *
+ * The absent hash values are not checked with KEYS_MPHF, which finds one of
+ * them with probability 2^-16 (its fingerprints are 16 bits).
+ */
+static void check_find(const FrozenSketchIndex& index, const std::map<hash_t, std::vector<int>>& reference,
+                        const std::vector<hash_t>& absent, const std::string& name) {
+    check(index.size() == reference.size(), name + ": size");
+    size_t num_wrong = 0;
+    for (const auto& [hash_value, sketch_indices] : reference) {
+        std::vector<int> found;
+        PostingView view = index.find(hash_value);
+        view.for_each([&found](int sketch_index) { found.push_back(sketch_index); });
+        if (found != sketch_indices || view.size() != sketch_indices.size()) {
+            num_wrong++;
+        }
+    }
+    check(num_wrong == 0, name + ": find of present hash values (" + std::to_string(num_wrong) + " wrong)");
+    if (index.keys_layout() != KEYS_MPHF) {
+        size_t num_found = 0;
+        for (hash_t hash_value : absent) {
+            num_found += !index.find(hash_value).empty() || index.hash_exists(hash_value);
+        }
+        check(num_found == 0, name + ": find of absent hash values (" + std::to_string(num_found) + " found)");
+    }
+}
+
+
+
+/**
+ * @brief Check lookup_batch against find on the expected index, for the present and absent hash values.
+ *
+ * The absent hash values are left out with KEYS_MPHF (see check_find).
+ */
+static void check_lookup_batch(const FrozenSketchIndex& index, const FrozenSketchIndex& expected_index,
+                                const std::map<hash_t, std::vector<int>>& reference,
+                                const std::vector<hash_t>& absent, const std::string& name) {
+    std::vector<hash_t> hashes;
+    for (const auto& [hash_value, sketch_indices] : reference) {
+        hashes.push_back(hash_value);
+    }
+    if (index.keys_layout() != KEYS_MPHF) {
+        hashes.insert(hashes.end(), absent.begin(), absent.end());
+    }
+    std::sort(hashes.begin(), hashes.end());
+
+    size_t num_calls = 0;
+    size_t num_wrong = 0;
+    index.lookup_batch(hashes.data(), hashes.size(), [&](size_t i, const PostingView& view) {
+        std::vector<int> found;
+        std::vector<int> expected;
+        view.decode(found);
+        expected_index.find(hashes[i]).decode(expected);
+        num_wrong += i != num_calls || found != expected || view.size() != expected.size();
+        num_calls++;
+    });
+    check(num_calls == hashes.size(), name + ": lookup_batch calls");
+    check(num_wrong == 0, name + ": lookup_batch (" + std::to_string(num_wrong) + " wrong)");
+}
+
+
+
+/**
+ * @brief Build an index with a key layout, check the layout it chose and its lookups.
+ */
+static void test_key_layout(const std::vector<Sketch>& sketches, int key_bits, KeyLayout key_layout,
+                            KeyLayout expected_layout) {
+    std::string name = std::string(KEY_LAYOUT_NAMES[key_layout]) + " keys below 2^" + std::to_string(key_bits);
+    FrozenSketchIndex index(POSTINGS_RAW, key_layout);
+    index.build(sketches, 4);
+    check(index.keys_layout() == expected_layout,
+            name + ": layout " + KEY_LAYOUT_NAMES[index.keys_layout()] + " instead of " + KEY_LAYOUT_NAMES[expected_layout]);
+    std::map<hash_t, std::vector<int>> reference = reference_of(sketches);
+    check_find(index, reference, absent_hashes(reference, key_bits), name);
+}
+
+
+
+/**
+ * @brief Build an index with every key layout and a posting codec, check its lookups and batched lookups.
+ */
+static void test_posting_codec(const std::vector<Sketch>& sketches, PostingCodec codec, const std::string& codec_name) {
+    std::map<hash_t, std::vector<int>> reference = reference_of(sketches);
+    std::vector<hash_t> absent = absent_hashes(reference, 64);
+    FrozenSketchIndex expected_index(POSTINGS_RAW, KEYS_SORTED);
+    expected_index.build(sketches, 4);
+
+    for (KeyLayout key_layout : {KEYS_SORTED, KEYS_ELIAS_FANO, KEYS_MPHF, KEYS_DIRECTORY}) {
+        std::string name = codec_name + " lists, " + KEY_LAYOUT_NAMES[key_layout] + " keys";
+        FrozenSketchIndex index(codec, key_layout);
+        index.build(sketches, 4);
+        check(index.num_postings() == expected_index.num_postings(), name + ": number of postings");
+        check_find(index, reference, absent, name);
+        check_lookup_batch(index, expected_index, reference, absent, name);
+    }
+}
+
+
+
+int main() {
+    // spread keys: 64-bit layouts, dense keys: the 32-bit ones where there are
+    std::vector<Sketch> spread_sketches = make_sketches(100, 50, 64);
+    std::vector<Sketch> dense_sketches = make_sketches(100, 50, 28);
+
+    test_key_layout(spread_sketches, 64, KEYS_SORTED, KEYS_SORTED);
+    test_key_layout(dense_sketches, 28, KEYS_SORTED, KEYS_SORTED_32);
+    test_key_layout(spread_sketches, 64, KEYS_ELIAS_FANO, KEYS_ELIAS_FANO);
+    test_key_layout(dense_sketches, 28, KEYS_ELIAS_FANO, KEYS_ELIAS_FANO);
+    test_key_layout(spread_sketches, 64, KEYS_MPHF, KEYS_MPHF);
+    test_key_layout(spread_sketches, 64, KEYS_DIRECTORY, KEYS_DIRECTORY);
+    test_key_layout(dense_sketches, 28, KEYS_DIRECTORY, KEYS_DIRECTORY_32);
+
+    // few sketches: 16-bit lists (and entries), many sketches: 32-bit lists (and entries),
+    // and the Roaring lists of hash values in more than ROARING_ARRAY_LIMIT sketches
+    std::vector<Sketch> many_sketches = make_sketches(70000, 2, 64, 5000);
+    test_posting_codec(spread_sketches, POSTINGS_RAW, "raw");
+    test_posting_codec(spread_sketches, POSTINGS_STREAMVBYTE, "streamvbyte");
+    test_posting_codec(many_sketches, POSTINGS_RAW, "raw");
+    test_posting_codec(many_sketches, POSTINGS_STREAMVBYTE, "streamvbyte");
+
+    if (num_failures > 0) {
+        std::cerr << num_failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All tests passed" << std::endl;
+    return 0;
+}